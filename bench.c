@@ -1,8 +1,12 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <time.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
 
 #ifdef TB32_BENCH
 #include "turbob64.h"
@@ -17,33 +21,48 @@
 #endif
 #else
 #include "crzy64.h"
+#ifndef _WIN32
+#include "crzy64_reader.h"
+#include "crzy64_pool.h"
+#endif
 #endif
 
 #ifdef RDTSC_FREQ
 /* useful if you set a static CPU frequency  */
 #include <x86intrin.h>
 #define TIMER_FREQ RDTSC_FREQ
-static int64_t get_time_usec() {
+#define TIMER_NAME "rdtscp"
+#define TIMER_UNIT "cycles"
+static int64_t get_time(void) {
 	unsigned aux;
 	return __rdtscp(&aux);
 }
 #else
-#define TIMER_FREQ 1e6
+#define TIMER_FREQ 1e9
+#define TIMER_UNIT "ns"
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
-static int64_t get_time_usec() {
+#define TIMER_NAME "qpc"
+static int64_t get_time(void) {
 	LARGE_INTEGER freq, perf;
 	QueryPerformanceFrequency(&freq);
 	QueryPerformanceCounter(&perf);
-	return perf.QuadPart * 1000000.0 / freq.QuadPart;
+	return perf.QuadPart * 1e9 / freq.QuadPart;
 }
 #else
-#include <sys/time.h>
-static int64_t get_time_usec() {
-	struct timeval time;
-	gettimeofday(&time, NULL);
-	return time.tv_sec * (int64_t)1000000 + time.tv_usec;
+/* not affected by NTP adjustments */
+#ifdef CLOCK_MONOTONIC_RAW
+#define TIMER_CLOCK CLOCK_MONOTONIC_RAW
+#define TIMER_NAME "monotonic_raw"
+#else
+#define TIMER_CLOCK CLOCK_MONOTONIC
+#define TIMER_NAME "monotonic"
+#endif
+static int64_t get_time(void) {
+	struct timespec t;
+	clock_gettime(TIMER_CLOCK, &t);
+	return t.tv_sec * (int64_t)1000000000 + t.tv_nsec;
 }
 #endif
 #endif
@@ -60,16 +79,67 @@ static uint32_t bench_rand(uint32_t n) {
 	return tmp * (uint64_t)n >> 32;
 }
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define BENCH_FLUSH 1
+#else
+#define BENCH_FLUSH 0
+#endif
+
+/* evicts blocks before the call: 1 - clflush, 2 - eviction sweep */
+static int evict_mode;
+static uint8_t *evict_buf;
+static size_t evict_size;
+
+static void bench_flush(const uint8_t *p, size_t n) {
+#if BENCH_FLUSH
+	const uint8_t *e = p + n;
+	p -= (uintptr_t)p & 63;
+	for (; p < e; p += 64)
+#ifdef __CLFLUSHOPT__
+		_mm_clflushopt((void*)p);
+#else
+		_mm_clflush(p);
+#endif
+#else
+	(void)p; (void)n;
+#endif
+}
+
+static void bench_evict(const uint8_t *d, size_t n4,
+		const uint8_t *s, size_t n3) {
+	size_t i;
+	if (evict_mode == 1) {
+		bench_flush(d, n4);
+		bench_flush(s, n3);
+#if BENCH_FLUSH
+		_mm_mfence();
+#endif
+	} else {
+		/* writes make the lines dirty, which also
+		 * evicts them from the inclusive caches */
+		for (i = 0; i < evict_size; i += 64) evict_buf[i]++;
+	}
+}
+
 #include "bench_svg.h"
 #include <math.h>
+#include "bench_perf.h"
+#include "bench_stats.h"
+#include "bench_roof.h"
+#include "bench_compare.h"
 
+/* (results) are memcpy, encode and decode rows of (nx + 1) values,
+ * the x axis is log2 if (xstep) is zero, (roof) marks the block
+ * sizes where encode/decode traffic fills a cache level */
 static void write_svg(const char *base, const char *name,
-		float (*results)[21], float max) {
+		float *results, int nx, int xstep, float max,
+		const bench_roof_t *roof) {
 	svg_writer_t svg = {
 		20, 10,
 		100, 50, 50, /* x */
 		100, 50, 70, /* y */
-		0, 0, NULL
+		0, 0, NULL, 0, 0
 	};
 	int i, j;
 	float mul = 1.0f / 1024;
@@ -82,11 +152,15 @@ static void write_svg(const char *base, const char *name,
 	strcpy(buf, base);
 	strcpy(buf + n, name);
 
+	svg.nx = nx;
+	svg.xstep = xstep;
+	if (nx > 20) svg.xm = 1000 / nx;
+
 	/* skip memcpy */
 	if (max == 0)
 	for (j = 1; j < 3; j++)
-	for (i = 0; i <= 20; i++)
-		if (max < results[j][i]) max = results[j][i];
+	for (i = 0; i <= nx; i++)
+		if (max < results[j * (nx + 1) + i]) max = results[j * (nx + 1) + i];
 
 	x = max * (1024 * 1.5f / svg.ny);
 	x |= 1;
@@ -104,26 +178,187 @@ static void write_svg(const char *base, const char *name,
 
 	if (!svg_start(&svg, buf, i, unit)) {
 		fprintf(svg.f, "<!-- memcpy -->\n");
-		svg_graph(&svg, "red", results[0], mul);
+		svg_graph(&svg, "red", results, mul);
 		fprintf(svg.f, "<!-- encode -->\n");
-		svg_graph(&svg, "green", results[1], mul);
+		svg_graph(&svg, "green", results + nx + 1, mul);
 		fprintf(svg.f, "<!-- decode -->\n");
-		svg_graph(&svg, "blue", results[2], mul);
+		svg_graph(&svg, "blue", results + (nx + 1) * 2, mul);
+		if (roof)
+		for (i = 0; i < roof->n - 1; i++)
+			svg_vline(&svg, log2(roof->size[i] * 3 / 7.0), roof->name[i]);
 		svg_end(&svg);
 	}
 	free(buf);
 }
 
+/* per call time for 0..256 bytes, the linear x axis */
+static void write_latency_svg(const char *base, float (*results)[257]) {
+	svg_writer_t svg = {
+		256, 10,
+		100, 50, 3, /* x */
+		100, 50, 50, /* y */
+		0, 0, NULL, 32, 0
+	};
+	int i, j;
+	float max = 0, step, p;
+	static const char * const clr[4] = { "green", "olive", "blue", "purple" };
+
+	int n = strlen(base);
+	char *buf = (char*)malloc(n + sizeof("_latency.svg"));
+	if (!buf) return;
+	strcpy(buf, base);
+	strcpy(buf + n, "_latency.svg");
+
+	for (j = 0; j < 4; j++)
+	for (i = 0; i <= 256; i++)
+		if (max < results[j][i]) max = results[j][i];
+
+	/* 1, 2 or 5 times a power of ten per grid line */
+	step = max / svg.ny;
+	p = powf(10, floorf(log10f(step > 0 ? step : 1)));
+	step = step <= p ? p : step <= 2 * p ? 2 * p : step <= 5 * p ? 5 * p : 10 * p;
+	svg.ny = ceilf(max / step);
+	if (svg.ny < 1) svg.ny = 1;
+
+	if (!svg_start(&svg, buf, step, TIMER_UNIT[0] == 'n' ? "ns" : "c")) {
+		for (j = 0; j < 4; j++) {
+			fprintf(svg.f, "<!-- %s %s -->\n", j < 2 ? "encode" : "decode",
+					j & 1 ? "throughput" : "latency");
+			svg_graph(&svg, clr[j], results[j], 1 / step);
+		}
+		svg_end(&svg);
+	}
+	free(buf);
+}
+
+#ifndef _WIN32
+#include <pthread.h>
+
+/* threads that run the same operation in lockstep */
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	unsigned nthreads, count, gen;
+} mt_barrier_t;
+
+static void mt_barrier_wait(mt_barrier_t *b) {
+	unsigned gen;
+	pthread_mutex_lock(&b->lock);
+	gen = b->gen;
+	if (++b->count >= b->nthreads) {
+		b->count = 0; b->gen++;
+		pthread_cond_broadcast(&b->cond);
+	} else while (gen == b->gen)
+		pthread_cond_wait(&b->cond, &b->lock);
+	pthread_mutex_unlock(&b->lock);
+}
+
+/* Every thread has private buffers allocated after pinning, so the
+ * first touch places them on the local NUMA node. Runs memcpy, encode
+ * and decode (nrep) times each, every run between two barriers. */
+typedef struct {
+	mt_barrier_t *bar;
+	size_t n1, n2;
+	int cpu;
+	unsigned nrep;
+	int64_t best[3];
+} mt_bench_t;
+
+static void *mt_bench_thread(void *arg) {
+	mt_bench_t *a = (mt_bench_t*)arg;
+	size_t n1 = a->n1, n2 = a->n2, i;
+	uint8_t *buf, *out = NULL;
+	unsigned op, k;
+	if (a->cpu >= 0) bench_pin(a->cpu);
+	if ((buf = (uint8_t*)malloc(n1 + n2))) {
+		out = buf + n1;
+		for (i = 0; i < n1; i++) buf[i] = i ^ 0x55;
+		crzy64_encode(out, buf, n1);
+	}
+	for (op = 0; op < 3; op++)
+	for (k = 0; k < a->nrep; k++) {
+		int64_t t;
+		mt_barrier_wait(a->bar);
+		t = get_time();
+		if (buf) switch (op) {
+		case 0: memcpy(out, buf, n1); break;
+		case 1: crzy64_encode(out, buf, n1); break;
+		default: crzy64_decode(buf, out, n2);
+		}
+		t = get_time() - t;
+		a->best[op] = !buf ? 0 : !k || t < a->best[op] ? t : a->best[op];
+		mt_barrier_wait(a->bar);
+	}
+	free(buf);
+	return NULL;
+}
+#endif
+
+#ifdef CRZY64_POOL_H
+/* simulates a server encoding responses of 1..64K bytes,
+ * mode: 0 - malloc, 1 - pool, 2 - a single preallocated buffer */
+typedef struct {
+	const uint8_t *src;
+	unsigned nreq, seed, mode;
+} pool_bench_t;
+
+static void *pool_bench_thread(void *arg) {
+	pool_bench_t *a = (pool_bench_t*)arg;
+	unsigned k, seed = a->seed;
+	uint8_t *d, *tmp = NULL;
+	if (a->mode == 2 && !(tmp = (uint8_t*)malloc(crzy64_encoded_size(1 << 16))))
+		return NULL;
+	for (k = 0; k < a->nreq; k++) {
+		size_t n = ((seed = seed * 0xdeece66d + 11) >> 16) + 1;
+		if (a->mode == 1) {
+			crzy64_buf_t b = crzy64_pool_encode(a->src, n);
+			crzy64_buf_release(&b);
+		} else if (a->mode == 2) {
+			crzy64_encode(tmp, a->src, n);
+		} else {
+			if ((d = (uint8_t*)malloc(crzy64_encoded_size(n))))
+				crzy64_encode(d, a->src, n);
+			free(d);
+		}
+	}
+	free(tmp);
+	return NULL;
+}
+
+static void pool_bench(const uint8_t *src, unsigned nthreads,
+		unsigned nreq, unsigned mode) {
+	pthread_t th[16]; pool_bench_t a[16];
+	unsigned i;
+	for (i = 0; i < nthreads; i++) {
+		a[i].src = src; a[i].nreq = nreq;
+		a[i].seed = i * 12345 + 1; a[i].mode = mode;
+		if (pthread_create(th + i, NULL, pool_bench_thread, a + i)) break;
+	}
+	while (i) pthread_join(th[--i], NULL);
+}
+#endif
+
 int main(int argc, char **argv) {
 	size_t i, j, n = 100, n1, n2;
 	uint8_t *buf, *out;
-	unsigned nrep = 5, nlimit = 100;
-	int64_t t0, t1;
+	unsigned nrep = 5, nlimit = 100, nwarm = 1;
+	int64_t t0, t1, samples[1000], spin;
 	float results[3][21];
-	const char *svg_name = NULL;
+	const char *svg_name = NULL, *json_name = NULL, *csv_name = NULL;
+	const char *cmp_a = NULL, *cmp_b = NULL;
+	double cmp_thr = 0.03;
 	float svg_max = 0;
+	int cpu = -1, perf = 0, latency = 0, nthreads = 0, tlb = 0;
+	int block_cached = 0;
+	bench_roof_t roof;
+	int cpus[256], ncpu = 0;
+	bench_out_t bout;
+	bench_perf_t bperf;
+	double bsize = 0, bbytes = 0, bcalls = 0;
+	char config[512], gov[64], boost[16];
 
 	randseed = time(NULL);
+	roof.n = 0;
 
 	while (argc > 1) {
 		if (argc > 2 && !strcmp(argv[1], "-m")) {
@@ -147,9 +382,76 @@ int main(int argc, char **argv) {
 		} else if (argc > 2 && !strcmp(argv[1], "--svg-max")) {
 			svg_max = atof(argv[2]);
 			argc -= 2; argv += 2;
+		} else if (argc > 2 && !strcmp(argv[1], "--warmup")) {
+			nwarm = atoi(argv[2]);
+			if (nwarm > 100) return 1;
+			argc -= 2; argv += 2;
+		} else if (argc > 2 && !strcmp(argv[1], "--cpu")) {
+			cpu = atoi(argv[2]);
+			argc -= 2; argv += 2;
+		} else if (argc > 2 && !strcmp(argv[1], "--json")) {
+			json_name = argv[2];
+			argc -= 2; argv += 2;
+		} else if (argc > 2 && !strcmp(argv[1], "--csv")) {
+			csv_name = argv[2];
+			argc -= 2; argv += 2;
+		} else if (!strcmp(argv[1], "--perf")) {
+			perf = 1;
+			argc -= 1; argv += 1;
+		} else if (!strcmp(argv[1], "--latency")) {
+			latency = 1;
+			argc -= 1; argv += 1;
+		} else if (argc > 2 && !strcmp(argv[1], "--cold")) {
+			if (!strcmp(argv[2], "flush") && BENCH_FLUSH) evict_mode = 1;
+			else if (!strcmp(argv[2], "sweep")) evict_mode = 2;
+			else return 1;
+			argc -= 2; argv += 2;
+		} else if (argc > 3 && !strcmp(argv[1], "--compare")) {
+			cmp_a = argv[2]; cmp_b = argv[3];
+			argc -= 3; argv += 3;
+		} else if (argc > 2 && !strcmp(argv[1], "--threshold")) {
+			cmp_thr = atof(argv[2]) / 100;
+			if (!(cmp_thr >= 0 && cmp_thr < 1)) return 1;
+			argc -= 2; argv += 2;
+		} else if (!strcmp(argv[1], "--roofline")) {
+			roof.n = -1;
+			argc -= 1; argv += 1;
+		} else if (!strcmp(argv[1], "--tlb")) {
+			tlb = 1;
+			argc -= 1; argv += 1;
+		} else if (argc > 2 && !strcmp(argv[1], "--threads")) {
+			nthreads = atoi(argv[2]);
+			if (nthreads - 1u >= 256) return 1;
+			argc -= 2; argv += 2;
+		} else if (argc > 2 && !strcmp(argv[1], "--cpus")) {
+			const char *p = argv[2];
+			for (ncpu = 0; ncpu < 256 && *p; ncpu++) {
+				cpus[ncpu] = strtol(p, (char**)&p, 10);
+				if (*p == ',') p++;
+				else if (*p) return 1;
+			}
+			argc -= 2; argv += 2;
 		} else break;
 	}
 
+	if (cmp_a) {
+		int nreg = bench_compare(cmp_a, cmp_b, svg_name, cmp_thr);
+		return nreg < 0 ? 2 : nreg > 0;
+	}
+
+	if (!ncpu) ncpu = bench_cpus(cpus, 256);
+	cpu = bench_pin(cpu);
+	bench_sysfs(gov, sizeof(gov),
+			"/sys/devices/system/cpu/cpu%d/cpufreq/scaling_governor", cpu);
+	bench_sysfs(boost, sizeof(boost),
+			"/sys/devices/system/cpu/cpufreq/boost", 0);
+	if (!boost[0]) {
+		bench_sysfs(boost, sizeof(boost),
+				"/sys/devices/system/cpu/intel_pstate/no_turbo", 0);
+		if (boost[0]) boost[0] ^= 1;
+	}
+	spin = bench_spin(get_time);
+
 #ifdef TB32_BENCH
 	printf("TB64: %s\n", TB32_NAME); 
 #else
@@ -178,10 +480,38 @@ int main(int argc, char **argv) {
 		", unaligned: yes"
 #else
 		", unaligned: no"
+#endif
+#if CRZY64_HAS_USDT
+		", usdt: yes"
 #endif
 		"\n");
 #endif
-	printf("size: %u MB, repeat: %u, limit: %u\n\n", (int)n, nrep, nlimit);
+	printf("size: %u MB, repeat: %u, limit: %u\n", (int)n, nrep, nlimit);
+	printf("cpu: %d, timer: %s", cpu, TIMER_NAME);
+	if (gov[0]) printf(", governor: %s", gov);
+	if (boost[0]) printf(", boost: %s", boost[0] == '1' ? "on" : "off");
+	printf("\n");
+	if (gov[0] && strcmp(gov, "performance"))
+		printf("warning: the frequency may change during the run\n");
+	bperf.count = 0;
+	if (perf) {
+		if (!bench_perf_open(&bperf))
+			printf("warning: perf counters are not available\n");
+		else {
+			printf("perf:");
+			for (i = 0; i < BENCH_PERF_EVENTS; i++)
+				if (bperf.fd[i] >= 0) printf(" %s", bench_perf_names[i]);
+			printf("\n");
+		}
+	}
+	printf("\n");
+
+	snprintf(config, sizeof(config),
+			"\"size_mb\": %u, \"repeat\": %u, \"warmup\": %u, \"limit\": %u, "
+			"\"cpu\": %d, \"timer\": \"%s\", \"governor\": \"%s\", "
+			"\"boost\": \"%s\"", (int)n, nrep, nwarm, nlimit,
+			cpu, TIMER_NAME, gov, boost);
+	bench_out_open(&bout, json_name, csv_name, TIMER_FREQ, config);
 
 	n1 = n << 20;
 	n2 = (n1 * 4 + 2) / 3;
@@ -190,31 +520,303 @@ int main(int argc, char **argv) {
 
 	if (!(buf = (uint8_t*)malloc(n1 + n2 + 1))) return 1;
 	out = buf + n1;
+	if (roof.n) {
+		bench_roof_init(&roof, cpu, buf, n1, get_time, TIMER_FREQ, nrep);
+		printf("roofline (MB/s):\n"
+				"level   size      read     write      copy\n");
+		for (i = 0; i < (size_t)roof.n; i++)
+			printf("%-4s %6u%c %9.0f %9.0f %9.0f\n", roof.name[i],
+					(int)(roof.size[i] >> (roof.size[i] >> 20 ? 20 : 10)),
+					roof.size[i] >> 20 ? 'M' : 'K',
+					roof.read[i], roof.write[i], roof.copy[i]);
+		if (roof.n > 1 && roof.size[roof.n - 2] > n1)
+			printf("warning: the last level cache is larger than %u MB\n", (int)n);
+		printf("\n");
+	}
 	for (i = 0; i < n1 + n2; i++) buf[i] = i ^ 0x55;
 
+#define BENCH_SET(sec, size, bytes, calls) \
+	(bout.section = sec, bsize = size, bbytes = bytes, bcalls = calls)
 #define BENCH(name, code) \
+	for (i = 0; i < nwarm; i++) { code; } \
+	if (bperf.count) bench_perf_start(&bperf); \
 	for (t1 = i = 0; i < nrep; i++) { \
-		t0 = get_time_usec(); \
+		t0 = get_time(); \
 		code; \
-		t0 = get_time_usec() - t0; \
+		t0 = get_time() - t0; \
+		samples[i] = t0; \
 		if (!i || t0 < t1) t1 = t0; \
 	} \
-	BENCH_PRINT(name)
+	if (bperf.count) bench_perf_stop(&bperf, nrep); \
+	BENCH_PRINT(name) \
+	BENCH_PERF_PRINT \
+	bench_record(&bout, name, bsize, bbytes, bcalls, samples, nrep, &bperf);
+#define BENCH_PERF_PRINT bench_perf_print(&bperf, bbytes);
+
+	if (latency) {
+		/* per call time for every size, a dependent call takes
+		 * the input address from the output of the previous one */
+		static float lat[4][257];
+		double cyc[4];
+		size_t ncall = 10000, k, x, z;
+		volatile size_t zero = 0;
+#define BENCH_PRINT(name) \
+	cyc[j] = bperf.count && bperf.val[0] >= 0 ? bperf.val[0] / ncall : -1; \
+	lat[j++][x] = (double)t1 / ncall;
+#undef BENCH_PERF_PRINT
+#define BENCH_PERF_PRINT
+		printf("%s per call, dependent calls (latency) and independent calls (throughput):\n"
+				"size  enc_lat enc_tput  dec_lat dec_tput\n", TIMER_UNIT);
+		crzy64_encode(out, buf, n1);
+		z = zero;
+		for (x = 0; x <= 256; x++) {
+			size_t m = (x * 4 + 2) / 3;
+			j = 0;
+			BENCH_SET("latency", x, x * ncall, ncall);
+			BENCH("encode_dep", for (k = 0; k < ncall; k++)
+				crzy64_encode(out, buf + (out[0] & z), x))
+			BENCH("encode", for (k = 0; k < ncall; k++)
+				crzy64_encode(out + (k & 255), buf + (k & 255), x))
+			BENCH("decode_dep", for (k = 0; k < ncall; k++)
+				crzy64_decode(buf, out + (buf[0] & z), m))
+			BENCH("decode", for (k = 0; k < ncall; k++)
+				crzy64_decode(buf + (k & 255), out + (k & 255), m))
+			printf("%4u %8.2f %8.2f %8.2f %8.2f", (int)x,
+					lat[0][x], lat[1][x], lat[2][x], lat[3][x]);
+			if (cyc[0] >= 0)
+				printf("  (%.1f %.1f %.1f %.1f cycles)",
+						cyc[0], cyc[1], cyc[2], cyc[3]);
+			printf("\n");
+		}
+		if (svg_name) write_latency_svg(svg_name, lat);
+		goto done;
+#undef BENCH_PRINT
+	}
+
+#ifndef _WIN32
+	if (nthreads) {
+		/* aggregate bandwidth of 1..N threads, n MB per thread */
+		mt_barrier_t bar;
+		mt_bench_t *a = (mt_bench_t*)malloc(nthreads * sizeof(*a));
+		pthread_t *th = (pthread_t*)malloc(nthreads * sizeof(*th));
+		float *mt = (float*)calloc(3 * (nthreads + 1), sizeof(float));
+		double per[3];
+		char sec[24];
+		int nt, k, op, last = 0;
+		if (!a || !th || !mt) return 1;
+		pthread_mutex_init(&bar.lock, NULL);
+		pthread_cond_init(&bar.cond, NULL);
+		bar.count = bar.gen = 0;
+#define BENCH_PRINT(name) \
+	mt[op++ * (nthreads + 1) + nt] = bbytes * (TIMER_FREQ / (1 << 20)) / t1;
+#define MT_STEP (mt_barrier_wait(&bar), mt_barrier_wait(&bar))
+		printf("cpus:");
+		for (k = 0; k < ncpu; k++) printf(" %d", cpus[k]);
+		printf("\n\naggregate GB/s (per thread GB/s), %u MB per thread:\n"
+				"threads  memcpy            encode            decode\n", (int)n);
+		for (nt = 1; nt <= nthreads; nt++) {
+			bar.nthreads = nt + 1;
+			for (k = 0; k < nt; k++) {
+				a[k].bar = &bar; a[k].n1 = n1; a[k].n2 = n2;
+				a[k].cpu = ncpu ? cpus[k % ncpu] : -1;
+				a[k].nrep = nwarm + nrep;
+				if (pthread_create(th + k, NULL, mt_bench_thread, a + k)) break;
+			}
+			if (k < nt) {
+				pthread_mutex_lock(&bar.lock);
+				bar.nthreads = k + 1;
+				pthread_mutex_unlock(&bar.lock);
+				printf("warning: can't create more than %d threads\n", k);
+				last = 1;
+				if (!(nt = k)) break;
+			}
+			snprintf(sec, sizeof(sec), "threads_%d", nt);
+			BENCH_SET(sec, n1, (double)n1 * nt, nt);
+			op = 0;
+			BENCH("memcpy", MT_STEP)
+			BENCH("encode", MT_STEP)
+			BENCH("decode", MT_STEP)
+			for (op = 0; op < 3; op++) per[op] = 0;
+			while (k) {
+				pthread_join(th[--k], NULL);
+				for (op = 0; op < 3; op++)
+					if (a[k].best[op]) per[op] += n1 * TIMER_FREQ / a[k].best[op];
+			}
+			printf("%7d", nt);
+			for (op = 0; op < 3; op++)
+				printf("  %7.2f (%6.2f)", mt[op * (nthreads + 1) + nt] / 1024,
+						per[op] / nt / (1 << 30));
+			printf("\n");
+			if (last) break;
+		}
+		if (svg_name) {
+			float max = svg_max;
+			if (!max)
+			for (k = 0; k < 3 * (nthreads + 1); k++)
+				if (max < mt[k]) max = mt[k];
+			write_svg(svg_name, "_threads.svg", mt, nthreads,
+					nthreads <= 20 ? 1 : (nthreads + 9) / 10, max, NULL);
+		}
+		pthread_cond_destroy(&bar.cond);
+		pthread_mutex_destroy(&bar.lock);
+		free(a); free(th); free(mt);
+		goto done;
+#undef MT_STEP
+#undef BENCH_PRINT
+	}
+#endif
+#undef BENCH_PERF_PRINT
+#define BENCH_PERF_PRINT bench_perf_print(&bperf, bbytes);
+
 #define BENCH_PRINT(name) \
 	printf("%s: %.3fms (%.2f MB/s)\n", name, \
 			t1 * (1e6 / TIMER_FREQ * 0.001), n1 * (TIMER_FREQ / (1 << 20)) / t1);
 
+	BENCH_SET("main", n1, n1, 1);
 	BENCH("memcpy", memcpy(out, buf, n1))
 	BENCH("encode", crzy64_encode(out, buf, n1))
 	BENCH("decode", crzy64_decode(buf, out, n2))
 	BENCH("encode_unaligned", crzy64_encode(out + 1, buf + 1, n1))
 	BENCH("decode_unaligned", crzy64_decode(buf + 1, out + 1, n2))
 
+#ifndef TB32_BENCH
+	{
+		/* the worst case, the needle is never found */
+		uint8_t needle[16]; volatile size_t pos;
+		for (i = 0; i < sizeof(needle); i++) needle[i] = bench_rand(256);
+		crzy64_encode(out, buf, n1);
+		BENCH_SET("find", n1, n1, 1);
+		BENCH("find", pos = crzy64_find(out, n2, needle, sizeof(needle)))
+#ifndef _WIN32
+		BENCH("decode+memmem", crzy64_decode(buf, out, n2);
+				pos = (uint8_t*)memmem(buf, n1, needle, sizeof(needle)) - buf)
+#endif
+		(void)pos;
+	}
+#endif
+
+#ifndef TB32_BENCH
+	{
+		/* byte ranges of 48K objects, 64K when encoded */
+		size_t obj = 3 << 14, nobj = n1 / obj, len = 64, nread = 10000, k, x;
+		uint8_t *tmp = (uint8_t*)malloc(obj);
+		if (!tmp || !nobj) return 1;
+		crzy64_encode(out, buf, n1);
 #undef BENCH_PRINT
 #define BENCH_PRINT(name) \
-	printf("%s (%u%s): %.2f MB/s\n", name, \
+	printf("%s: %.1f ns/read\n", name, t1 * (1e9 / TIMER_FREQ) / nread);
+		printf("\nrandom reads of %u bytes from %u KB objects:\n",
+				(int)len, (int)(obj >> 10));
+		BENCH_SET("range", len, len * nread, nread);
+		BENCH("decode_range", for (k = 0; k < nread; k++) {
+			x = bench_rand(nobj);
+			crzy64_decode_range(tmp, out + (x << 16), 1 << 16,
+					bench_rand(obj - len), len);
+		})
+		BENCH("full decode", for (k = 0; k < nread; k++) {
+			x = bench_rand(nobj);
+			crzy64_decode(tmp, out + (x << 16), 1 << 16);
+			memmove(tmp, tmp + bench_rand(obj - len), len);
+		})
+		free(tmp);
+	}
+#endif
+
+#ifdef CRZY64_READER_H
+	{
+		/* encoded file in the page cache, 1MB of decoded pages */
+		char fn[] = "/tmp/crzy64_benchXXXXXX";
+		size_t len = 64, nread = 100000, k, x;
+		crzy64_reader_t *r = NULL;
+		uint8_t tmp[CRZY64_PAGE];
+		int fd = mkstemp(fn);
+		if (fd >= 0) {
+			crzy64_encode(out, buf, n1);
+			if (write(fd, out, n2) == (ssize_t)n2)
+				r = crzy64_reader_open(fn, 256);
+			close(fd);
+			unlink(fn);
+		}
+		if (r) {
+			printf("\nreader (%u-byte random reads, 4K sequential reads):\n",
+					(int)len);
+			BENCH_SET("reader", len, len * nread, nread);
+			BENCH("random", for (k = 0; k < nread; k++)
+				crzy64_reader_read(r, tmp, bench_rand(n1 - len), len))
+			crzy64_reader_advise(r, 0, n1, POSIX_MADV_SEQUENTIAL);
+			nread = x = n1 / CRZY64_PAGE;
+			BENCH_SET("reader", CRZY64_PAGE, n1, x);
+			BENCH("sequential", for (k = 0; k < x; k++)
+				crzy64_reader_read(r, tmp, k * CRZY64_PAGE, CRZY64_PAGE))
+			BENCH("sequential pin", for (k = 0; k < x; k++) {
+				const uint8_t *p = crzy64_reader_pin(r, k * CRZY64_PAGE, &len);
+				crzy64_reader_unpin(r, p);
+			})
+			crzy64_reader_close(r);
+		}
+	}
+#endif
+
+#ifndef TB32_BENCH
+	{
+		/* per call latency for common key and digest sizes, a call
+		 * takes the input address from the output of the previous one */
+		size_t (*volatile enc)(uint8_t*, const uint8_t*, size_t) = crzy64_encode;
+		size_t (*volatile dec)(uint8_t*, const uint8_t*, size_t) = crzy64_decode;
+		size_t ncall = 100000, k, z;
+		volatile size_t zero = 0;
+#undef BENCH_PRINT
+#define BENCH_PRINT(name) \
+	printf("%s: %.2f " TIMER_UNIT "/call", name, (double)t1 / ncall); \
+	if (bperf.count && bperf.val[0] >= 0) \
+		printf(" (%.1f cycles/call)", bperf.val[0] / ncall); \
+	printf("\n");
+#define BENCH_FIXED(x) \
+	printf("\nfixed size %u:\n", x); \
+	BENCH_SET("fixed", x, x * ncall, ncall); \
+	BENCH("encode", for (k = 0; k < ncall; k++) \
+		enc(out, buf + (out[0] & z), x)) \
+	BENCH("encode_fixed", for (k = 0; k < ncall; k++) \
+		crzy64_encode_fixed(out, buf + (out[0] & z), x)) \
+	BENCH("decode", for (k = 0; k < ncall; k++) \
+		dec(buf, out + (buf[0] & z), (x * 4 + 2) / 3)) \
+	BENCH("decode_fixed", for (k = 0; k < ncall; k++) \
+		crzy64_decode_fixed(buf, out + (buf[0] & z), x))
+		crzy64_encode(out, buf, n1);
+		z = zero;
+		BENCH_FIXED(16) BENCH_FIXED(20) BENCH_FIXED(32) BENCH_FIXED(64)
+#undef BENCH_FIXED
+	}
+#endif
+
+#ifdef CRZY64_POOL_H
+	{
+		unsigned nreq = 20000, nthreads;
+		char sec[16];
+#undef BENCH_PRINT
+#define BENCH_PRINT(name) \
+	printf("%s: %.1f ns/request\n", name, \
+			t1 * (1e9 / TIMER_FREQ) / ((size_t)nreq * nthreads));
+		for (nthreads = 1; nthreads <= 16; nthreads *= 4) {
+			printf("\n%u threads encoding 1..64K responses:\n", nthreads);
+			snprintf(sec, sizeof(sec), "pool_%u", nthreads);
+			BENCH_SET(sec, 0, 0, nreq * nthreads);
+			BENCH("malloc", pool_bench(buf, nthreads, nreq, 0))
+			BENCH("pool", pool_bench(buf, nthreads, nreq, 1))
+			BENCH("preallocated", pool_bench(buf, nthreads, nreq, 2))
+		}
+	}
+#endif
+
+#undef BENCH_PRINT
+#define BENCH_PRINT(name) \
+	printf("%s (%u%s): %.2f MB/s", name, \
 			1 << j % 10, j < 10 ? "" : j < 20 ? "K" : "M", \
-			res = n * (TIMER_FREQ / (1 << 20)) / t1);
+			res = n * (TIMER_FREQ / (1 << 20)) / t1); \
+	bench_roof_print(&roof, (block_cached ? n3 : n) * BLOCK_TRAFFIC(name), \
+			BLOCK_TRAFFIC(name), res);
+/* bytes read and written per byte */
+#define BLOCK_TRAFFIC(name) (*(name) == 'm' ? 2.0 : 7 / 3.0)
 
 #define BENCH_BLOCK(name) \
 	for (j = 0; j <= 20; j++) { \
@@ -225,10 +827,12 @@ int main(int argc, char **argv) {
 		/* very slow, need limit */ \
 		n5 = n5 < nlimit ? n5 : nlimit; \
 		nn = n = n5 * n3; \
+		BENCH_SET(name, n3, n, n5); \
 		BENCH("memcpy", BLOCK(memcpy, out, buf, n3, n3)) \
 		results[0][j] = res; \
 		n5 = n6 < nlimit ? n6 : nlimit; \
 		nn = n = n5 * n3; \
+		BENCH_SET(name, n3, n, n5); \
 		BENCH("encode", BLOCK(crzy64_encode, out, buf, n3, n4)) \
 		results[1][j] = res; \
 		nn = n5 * n4; \
@@ -236,7 +840,8 @@ int main(int argc, char **argv) {
 		results[2][j] = res; \
 	} \
 	if (svg_name) \
-		write_svg(svg_name, "_" name ".svg", results, svg_max);
+		write_svg(svg_name, "_" name ".svg", results[0], 20, 0, svg_max, \
+				block_cached ? &roof : NULL);
 
 #define BLOCK(fn, d, s, n3, n4) do { \
 	size_t k = nn; \
@@ -244,7 +849,9 @@ int main(int argc, char **argv) {
 } while (0)
 
 	printf("\nblock repeat (cached):\n");
+	block_cached = 1;
 	BENCH_BLOCK("cached")
+	block_cached = 0;
 
 #undef BLOCK
 #define BLOCK(fn, d, s, n3, n4) do { \
@@ -274,5 +881,99 @@ int main(int argc, char **argv) {
 	printf("\nblock repeat (random order):\n");
 	BENCH_BLOCK("random")
 
+	if (evict_mode) {
+		/* the eviction isn't timed or counted, nor about one timer
+		 * call that is left outside of the subtracted interval */
+#undef BLOCK
+#define BLOCK(fn, d, s, n3, n4) do { \
+	size_t k, x; int64_t t; (void)nn; \
+	for (k = 0; k < n5; k++) { \
+		x = bench_rand(n5); \
+		t = get_time(); \
+		if (bperf.count) bench_perf_pause(&bperf, 1); \
+		bench_evict(d + x * n4, n4, s + x * n3, n3); \
+		if (bperf.count) bench_perf_pause(&bperf, 0); \
+		t0 += get_time() - t; \
+		fn(d + x * n4, s + x * n3, n3); \
+	} \
+	t0 += (int64_t)(n5 * tcost); \
+} while (0)
+		unsigned nlimit0 = nlimit;
+		double tcost = bench_timer_cost(get_time);
+		if (evict_mode == 2) {
+			/* twice the last level cache */
+			for (i = 0; i < 4; i++)
+				if (evict_size < bench_cache_size(cpu, i) * 2)
+					evict_size = bench_cache_size(cpu, i) * 2;
+			if (!evict_size) evict_size = 64 << 20;
+			if (!(evict_buf = (uint8_t*)calloc(evict_size, 1))) return 1;
+			/* very slow */
+			nlimit = 4;
+		}
+		printf("\nblock repeat (random order, cold cache, %s, "
+				"timer call %.1f " TIMER_UNIT " subtracted):\n",
+				evict_mode == 1 ? "clflush" : "eviction sweep", tcost);
+		BENCH_BLOCK("cold")
+		nlimit = nlimit0;
+		free(evict_buf);
+	}
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+	if (tlb) {
+		/* every block on its own page in random order,
+		 * pages are 64 bytes apart to spread the cache sets */
+#undef BLOCK
+#define BLOCK(fn, d, s, n3, n4) do { \
+	size_t k, x, a3 = ((n3 + 4095) & ~(size_t)4095) + 64; \
+	size_t a4 = ((n4 + 4095) & ~(size_t)4095) + 64; \
+	size_t ns = tsize / (a3 > a4 ? a3 : a4); (void)nn; \
+	for (k = 0; k < n5; k++) x = bench_rand(ns), \
+		fn(d + x * a4, s + x * a3, n3); \
+} while (0)
+		size_t tsize = (n2 + (2 << 20) - 1) & ~(size_t)((2 << 20) - 1), k;
+		char thp[64], *p;
+		/* "always [madvise] never" */
+		bench_sysfs(thp, sizeof(thp),
+				"/sys/kernel/mm/transparent_hugepage/enabled", 0);
+		if ((p = strchr(thp, '['))) {
+			memmove(thp, p + 1, strlen(p));
+			if ((p = strchr(thp, ']'))) *p = 0;
+		}
+		for (k = 0; k < 2; k++) {
+			/* aligned to 2MB for huge pages */
+			size_t msize = tsize * 2 + (2 << 20);
+			uint8_t *m = (uint8_t*)mmap(NULL, msize, PROT_READ | PROT_WRITE,
+					MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			uint8_t *buf, *out;
+			if (m == MAP_FAILED) return 1;
+			buf = m + (-(uintptr_t)m & ((2 << 20) - 1));
+			out = buf + tsize;
+			madvise(buf, tsize * 2, k ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+			for (i = 0; i < tsize; i++) buf[i] = i ^ 0x55;
+			crzy64_encode(out, buf, tsize / 4 * 3);
+			if (!k) {
+				printf("\nblock repeat (random pages, 4K pages):\n");
+				BENCH_BLOCK("tlb_4k")
+			} else {
+				printf("\nblock repeat (random pages, huge pages, thp: %s):\n",
+						thp[0] ? thp : "unknown");
+				BENCH_BLOCK("tlb_thp")
+			}
+			munmap(m, msize);
+		}
+	}
+#else
+	(void)tlb;
+#endif
+
+done:
+	{
+		double drift = (double)bench_spin(get_time) / spin - 1;
+		if (fabs(drift) > 0.03)
+			printf("\nwarning: CPU frequency changed by %.1f%% during the run\n",
+					drift * -100);
+		bench_out_close(&bout, drift);
+		if (bperf.count) bench_perf_close(&bperf);
+	}
 	return 0;
 }
@@ -0,0 +1,216 @@
+/*
+ * End-to-end throughput of the crzy64 binary through files, pipes
+ * and /dev/shm, with read/write syscalls (from /proc/PID/io), context
+ * switches and CPU time of the process. Linux only.
+ *
+ * crzy64_bench_cli [-r N] [-s MB,MB,...] [--dir DIR] [BINARY [ARGS...]]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "crzy64.h"
+
+static int64_t get_time(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * (int64_t)1000000000 + t.tv_nsec;
+}
+
+typedef struct {
+	int64_t time;
+	double cpu, syscr, syscw, nvcsw;
+	size_t out;
+} run_t;
+
+static int write_file(const char *fn, const uint8_t *p, size_t n) {
+	FILE *f = fopen(fn, "wb");
+	int ret = 1;
+	if (!f) return 1;
+	if (fwrite(p, 1, n, f) == n) ret = 0;
+	if (fclose(f)) ret = 1;
+	return ret;
+}
+
+static void write_all(int fd, const uint8_t *p, size_t n) {
+	ssize_t k;
+	while (n) {
+		if ((k = write(fd, p, n)) < 0) {
+			if (errno == EINTR) continue;
+			return;
+		}
+		p += k; n -= k;
+	}
+}
+
+/* reads "syscr" and "syscw" of an exited, not yet reaped, process */
+static void proc_io(pid_t pid, run_t *r) {
+	char fn[64], buf[128]; FILE *f;
+	r->syscr = r->syscw = -1;
+	snprintf(fn, sizeof(fn), "/proc/%d/io", (int)pid);
+	if (!(f = fopen(fn, "r"))) return;
+	while (fgets(buf, sizeof(buf), f)) {
+		if (!strncmp(buf, "syscr:", 6)) r->syscr = atof(buf + 6);
+		if (!strncmp(buf, "syscw:", 6)) r->syscw = atof(buf + 6);
+	}
+	fclose(f);
+}
+
+/* Runs the binary with stdin from (in) or a pipe fed with (data),
+ * and stdout to (out) or a pipe that is drained. */
+static int run(char **argv, const char *in, const char *out,
+		const uint8_t *data, size_t n, run_t *r) {
+	int pin[2] = { -1, -1 }, pout[2] = { -1, -1 }, fd0, fd1;
+	pid_t pid, feeder = -1;
+	siginfo_t si; struct rusage ru;
+	static uint8_t buf[1 << 20];
+	int status;
+
+	if (in) fd0 = open(in, O_RDONLY);
+	else if (pipe(pin)) return 1;
+	else fd0 = pin[0];
+	if (out) fd1 = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	else if (pipe(pout)) return 1;
+	else fd1 = pout[1];
+	if (fd0 < 0 || fd1 < 0) return 1;
+
+	if (!in && !(feeder = fork())) {
+		close(pin[0]);
+		if (pout[0] >= 0) close(pout[0]), close(pout[1]);
+		write_all(pin[1], data, n);
+		_exit(0);
+	}
+	r->time = get_time();
+	if (!(pid = fork())) {
+		dup2(fd0, 0); dup2(fd1, 1);
+		close(fd0); close(fd1);
+		if (pin[1] >= 0) close(pin[1]);
+		if (pout[0] >= 0) close(pout[0]);
+		execv(argv[0], argv);
+		_exit(127);
+	}
+	close(fd0); close(fd1);
+	if (pin[1] >= 0) close(pin[1]);
+	r->out = 0;
+	if (pout[0] >= 0) {
+		ssize_t k;
+		while ((k = read(pout[0], buf, sizeof(buf))))
+			if (k > 0) r->out += k;
+			else if (errno != EINTR) break;
+		close(pout[0]);
+	}
+	if (pid < 0 || waitid(P_PID, pid, &si, WEXITED | WNOWAIT)) return 1;
+	r->time = get_time() - r->time;
+	proc_io(pid, r);
+	if (wait4(pid, &status, 0, &ru) < 0) return 1;
+	if (feeder > 0) waitpid(feeder, NULL, 0);
+	r->cpu = ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+			(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1e-6;
+	r->nvcsw = ru.ru_nvcsw;
+	if (out) {
+		struct stat st;
+		r->out = stat(out, &st) ? 0 : st.st_size;
+	}
+	return !WIFEXITED(status) || WEXITSTATUS(status);
+}
+
+int main(int argc, char **argv) {
+	static const char * const modes[] = { "file", "shm", "pipe" };
+	const char *dir = ".", *sizes = "1,16,128", *p;
+	char *def[] = { (char*)"./crzy64", NULL };
+	char **args, fn[3][256];
+	unsigned nrep = 3;
+	int ret = 0, shm;
+
+	while (argc > 1) {
+		if (argc > 2 && !strcmp(argv[1], "-r")) {
+			nrep = atoi(argv[2]);
+			if (nrep - 1 >= 100) return 1;
+			argc -= 2; argv += 2;
+		} else if (argc > 2 && !strcmp(argv[1], "-s")) {
+			sizes = argv[2];
+			argc -= 2; argv += 2;
+		} else if (argc > 2 && !strcmp(argv[1], "--dir")) {
+			dir = argv[2];
+			argc -= 2; argv += 2;
+		} else break;
+	}
+	args = argc > 1 ? argv + 1 : def;
+	shm = !access("/dev/shm", W_OK);
+
+	printf("binary: %s, repeat: %u\n\n"
+			"mode  op       size      MB/s   rd/MB   wr/MB   cs/MB  cpu%%\n",
+			args[0], nrep);
+
+	for (p = sizes; *p; ) {
+		size_t mb = strtoul(p, (char**)&p, 10), n = mb << 20, n2, i;
+		uint8_t *raw, *enc;
+		uint32_t x = 1;
+		int m, op;
+
+		if (*p == ',') p++;
+		if (!mb || mb > 4096) return 1;
+		n2 = crzy64_encoded_size(n);
+		if (!(raw = (uint8_t*)malloc(n + n2))) return 1;
+		enc = raw + n;
+		for (i = 0; i < n; i++) {
+			x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+			raw[i] = x >> 24;
+		}
+		crzy64_encode(enc, raw, n);
+
+		for (m = 0; m < 3; m++) {
+			const char *d = m == 1 ? "/dev/shm" : dir;
+			if (m == 1 && !shm) continue;
+			snprintf(fn[0], sizeof(fn[0]), "%s/crzy64_cli_%d.raw", d, (int)getpid());
+			snprintf(fn[1], sizeof(fn[1]), "%s/crzy64_cli_%d.enc", d, (int)getpid());
+			snprintf(fn[2], sizeof(fn[2]), "%s/crzy64_cli_%d.out", d, (int)getpid());
+			if (m < 2 && (write_file(fn[0], raw, n) || write_file(fn[1], enc, n2))) {
+				fprintf(stderr, "can't write to %s\n", d);
+				ret = 1;
+				continue;
+			}
+			for (op = 0; op < 2; op++) {
+				char **a; int k = 0;
+				run_t r, best = { 0 };
+				unsigned j;
+				/* inserts "-d" after the binary */
+				while (args[k]) k++;
+				if (!(a = (char**)malloc((k + 2) * sizeof(*a)))) return 1;
+				a[0] = args[0];
+				if (op) a[1] = (char*)"-d";
+				memcpy(a + 1 + op, args + 1, k * sizeof(*a));
+				for (j = 0; j < nrep; j++) {
+					if (run(a, m < 2 ? fn[op] : NULL, m < 2 ? fn[2] : NULL,
+							op ? enc : raw, op ? n2 : n, &r) ||
+							r.out != (op ? n : n2)) {
+						fprintf(stderr, "%s %s failed\n", modes[m], op ? "decode" : "encode");
+						ret = 1;
+						break;
+					}
+					if (!j || r.time < best.time) best = r;
+				}
+				free(a);
+				if (j < nrep) continue;
+				printf("%-5s %-7s %4uMB %9.2f %7.1f %7.1f %7.1f %5.0f\n",
+						modes[m], op ? "decode" : "encode", (int)mb,
+						n * (1e9 / (1 << 20)) / best.time,
+						best.syscr / mb, best.syscw / mb, best.nvcsw / mb,
+						best.cpu * 1e11 / best.time);
+			}
+			if (m < 2) unlink(fn[0]), unlink(fn[1]), unlink(fn[2]);
+		}
+		free(raw);
+	}
+	return ret;
+}
@@ -0,0 +1,298 @@
+
+/* Compares two JSON files from --json: the speedup of B over A for
+ * every result found in both, with a confidence interval from Welch's
+ * t-test on the log of the samples, Bonferroni corrected for the number
+ * of results. Include after bench_svg.h. */
+
+typedef struct {
+	char section[32], name[32];
+	double size;
+	int n;
+	double *t;
+} cmp_result_t;
+
+typedef struct {
+	cmp_result_t *r;
+	int n;
+	char *text;
+} cmp_file_t;
+
+static void cmp_free(cmp_file_t *f) {
+	int i;
+	for (i = 0; i < f->n; i++) free(f->r[i].t);
+	free(f->r); free(f->text);
+}
+
+static void cmp_str(const char *p, const char *key, char *out, size_t size) {
+	const char *e;
+	size_t n;
+	out[0] = 0;
+	if (!(p = strstr(p, key))) return;
+	p += strlen(key);
+	if (!(e = strchr(p, '"'))) return;
+	if ((n = e - p) > size - 1) n = size - 1;
+	memcpy(out, p, n);
+	out[n] = 0;
+}
+
+/* only reads the format written by bench_record() */
+static int cmp_load(cmp_file_t *f, const char *fn) {
+	FILE *fp = fopen(fn, "rb");
+	size_t size = 0, k;
+	char *p, *next;
+	memset(f, 0, sizeof(*f));
+	if (!fp) return 1;
+	for (;;) {
+		char *q = (char*)realloc(f->text, size + 65537);
+		if (!q) { fclose(fp); return 1; }
+		f->text = q;
+		if (!(k = fread(q + size, 1, 65536, fp))) break;
+		size += k;
+	}
+	fclose(fp);
+	if (!f->text) return 1;
+	f->text[size] = 0;
+
+	for (p = strstr(f->text, "{\"section\""); p; p = next) {
+		cmp_result_t *r; char c = 0;
+		if ((next = strstr(p + 1, "{\"section\""))) c = *next, *next = 0;
+		if (!(f->n & (f->n - 1))) {
+			r = (cmp_result_t*)realloc(f->r, (f->n ? f->n * 2 : 1) * sizeof(*r));
+			if (!r) return 1;
+			f->r = r;
+		}
+		r = f->r + f->n;
+		cmp_str(p, "\"section\": \"", r->section, sizeof(r->section));
+		cmp_str(p, "\"name\": \"", r->name, sizeof(r->name));
+		r->size = 0; r->n = 0; r->t = NULL;
+		if ((p = strstr(p, "\"size\": "))) r->size = strtod(p + 8, NULL);
+		if (p && (p = strstr(p, "\"samples_ns\": ["))) {
+			char *e;
+			p += 15;
+			for (e = p, k = 1; *e && *e != ']'; e++) k += *e == ',';
+			if (!(r->t = (double*)malloc(k * sizeof(double)))) return 1;
+			while (r->n < (int)k) {
+				double x = strtod(p, &e);
+				if (e == p) break;
+				r->t[r->n++] = x;
+				for (p = e; *p == ',' || *p == ' '; p++);
+			}
+		}
+		if (next) *next = c;
+		f->n++;
+	}
+	return 0;
+}
+
+/* continued fraction for the incomplete beta function (Lentz) */
+static double cmp_betacf(double a, double b, double x) {
+	double c = 1, d = 1 - (a + b) * x / (a + 1), h, aa, del;
+	int m;
+#define CMP_TINY(x) if (fabs(x) < 1e-300) x = 1e-300;
+	CMP_TINY(d)
+	h = d = 1 / d;
+	for (m = 1; m <= 300; m++) {
+		aa = m * (b - m) * x / ((a + 2 * m - 1) * (a + 2 * m));
+		d = 1 + aa * d; CMP_TINY(d)
+		c = 1 + aa / c; CMP_TINY(c)
+		d = 1 / d; h *= d * c;
+		aa = -(a + m) * (a + b + m) * x / ((a + 2 * m) * (a + 2 * m + 1));
+		d = 1 + aa * d; CMP_TINY(d)
+		c = 1 + aa / c; CMP_TINY(c)
+		d = 1 / d; del = d * c; h *= del;
+		if (fabs(del - 1) < 1e-12) break;
+	}
+#undef CMP_TINY
+	return h;
+}
+
+/* regularized incomplete beta function */
+static double cmp_ibeta(double a, double b, double x) {
+	double f;
+	if (x <= 0) return 0;
+	if (x >= 1) return 1;
+	f = exp(lgamma(a + b) - lgamma(a) - lgamma(b) + a * log(x) + b * log(1 - x));
+	if (x < (a + 1) / (a + b + 2)) return f * cmp_betacf(a, b, x) / a;
+	return 1 - f * cmp_betacf(b, a, 1 - x) / b;
+}
+
+/* P(|T| > t) for the t-distribution */
+static double cmp_tail(double t, double df) {
+	return cmp_ibeta(df / 2, 0.5, df / (df + t * t));
+}
+
+/* two-sided quantile, P(|T| > t) = p */
+static double cmp_tq(double p, double df) {
+	double lo = 0, hi = 1;
+	int i;
+	while (cmp_tail(hi, df) > p && hi < 1e12) lo = hi, hi *= 2;
+	for (i = 0; i < 60; i++) {
+		double mid = (lo + hi) / 2;
+		if (cmp_tail(mid, df) > p) lo = mid; else hi = mid;
+	}
+	return hi;
+}
+
+static void cmp_logstat(const cmp_result_t *r, double *mean, double *var) {
+	double s = 0, sq = 0;
+	int i;
+	for (i = 0; i < r->n; i++) s += log(r->t[i]);
+	*mean = s / r->n;
+	for (i = 0; i < r->n; i++)
+		sq += (log(r->t[i]) - *mean) * (log(r->t[i]) - *mean);
+	*var = r->n > 1 ? sq / (r->n - 1) : 0;
+}
+
+/* Speedup of (b) over (a) as the ratio of geometric mean times,
+ * with the interval in (lo, hi) that misses with probability (alpha).
+ * Returns 0 if there are too few samples. */
+static int cmp_speedup(const cmp_result_t *a, const cmp_result_t *b,
+		double alpha, double *sp, double *lo, double *hi) {
+	double ma, va, mb, vb, se2, df, w;
+	if (!a->n || !b->n) return 0;
+	cmp_logstat(a, &ma, &va);
+	cmp_logstat(b, &mb, &vb);
+	*sp = *lo = *hi = exp(ma - mb);
+	if (a->n < 2 || b->n < 2) return 0;
+	va /= a->n; vb /= b->n;
+	se2 = va + vb;
+	/* Welch–Satterthwaite */
+	df = se2 > 0 ? se2 * se2 / (va * va / (a->n - 1) + vb * vb / (b->n - 1)) : 1e9;
+	w = cmp_tq(alpha, df) * sqrt(se2);
+	*lo = exp(ma - mb - w);
+	*hi = exp(ma - mb + w);
+	return 1;
+}
+
+/* Speedups of the block sweeps by log2 of the size, one SVG for each. */
+static void cmp_svg(const char *base, const cmp_file_t *a, const cmp_file_t *b) {
+	static const char * const names[3] = { "memcpy", "encode", "decode" };
+	static const char * const clr[3] = { "red", "green", "blue" };
+	char done[16][32], *fn;
+	int ndone = 0, i, j, k, m;
+
+	if (!(fn = (char*)malloc(strlen(base) + 64))) return;
+	for (i = 0; i < a->n && ndone < 16; i++) {
+		const char *sec = a->r[i].section;
+		float res[3][21], lo = 1, hi = 1, step, p;
+		int found = 0;
+		svg_writer_t svg = {
+			20, 10,
+			100, 50, 50, /* x */
+			100, 50, 70, /* y */
+			0, 0, NULL, 0, 0
+		};
+		/* sweeps have "memcpy (1)" ... "decode (1M)" */
+		if (a->r[i].size != 1 || strcmp(a->r[i].name, "memcpy")) continue;
+		for (k = 0; k < ndone; k++) if (!strcmp(done[k], sec)) break;
+		if (k < ndone) continue;
+		strcpy(done[ndone++], sec);
+
+		for (k = 0; k < 3; k++)
+		for (m = 0; m <= 20; m++) res[k][m] = 1;
+		for (j = 0; j < a->n; j++) {
+			const cmp_result_t *x = a->r + j;
+			double sp, l, h; int e;
+			if (strcmp(x->section, sec)) continue;
+			for (k = 0; k < 3; k++) if (!strcmp(x->name, names[k])) break;
+			frexp(x->size, &e);
+			if (k == 3 || x->size != ldexp(1, e - 1) || e > 21) continue;
+			for (m = 0; m < b->n; m++)
+				if (!strcmp(b->r[m].section, sec) && !strcmp(b->r[m].name, x->name)
+						&& b->r[m].size == x->size) break;
+			if (m == b->n) continue;
+			cmp_speedup(x, b->r + m, 0.05, &sp, &l, &h);
+			res[k][e - 1] = sp;
+			if (lo > sp) lo = sp;
+			if (hi < sp) hi = sp;
+			found++;
+		}
+		if (!found) continue;
+
+		/* 1, 2 or 5 times a power of ten per grid line */
+		step = (hi - lo) / 8;
+		p = powf(10, floorf(log10f(step > 0 ? step : 0.01f)));
+		step = step <= p ? p : step <= 2 * p ? 2 * p : step <= 5 * p ? 5 * p : 10 * p;
+		svg.ybase = floorf(lo / step) * step;
+		svg.ny = ceilf((hi - svg.ybase) / step);
+		if (svg.ny < 1) svg.ny = 1;
+		svg.ym = 700 / svg.ny;
+
+		sprintf(fn, "%s_diff_%s.svg", base, sec);
+		if (!svg_start(&svg, fn, step, "x")) {
+			float one[21];
+			for (m = 0; m <= 20; m++) one[m] = 1;
+			svg_graph(&svg, "gray", one, 1 / step);
+			for (k = 0; k < 3; k++) {
+				fprintf(svg.f, "<!-- %s -->\n", names[k]);
+				svg_graph(&svg, clr[k], res[k], 1 / step);
+			}
+			svg_end(&svg);
+		}
+	}
+	free(fn);
+}
+
+static const cmp_result_t *cmp_find(const cmp_file_t *f, const cmp_result_t *x) {
+	int i;
+	for (i = 0; i < f->n; i++)
+		if (!strcmp(f->r[i].section, x->section) &&
+				!strcmp(f->r[i].name, x->name) && f->r[i].size == x->size)
+			return f->r + i;
+	return NULL;
+}
+
+/* Prints the table, returns the number of regressions by more than
+ * (thr), e.g. 0.03, at 95% confidence for the whole table. */
+static int bench_compare(const char *fa, const char *fb, const char *svg,
+		double thr) {
+	cmp_file_t a, b;
+	int i, m = 0, raw[2] = { 0, 0 }, cor[2] = { 0, 0 }, nsame = 0;
+	double alpha;
+	const char *bad = NULL;
+
+	memset(&b, 0, sizeof(b));
+	if (cmp_load(&a, fa)) bad = fa;
+	else if (cmp_load(&b, fb)) bad = fb;
+	if (bad) {
+		fprintf(stderr, "crzy64_bench: can't read %s\n", bad);
+		cmp_free(&a); cmp_free(&b);
+		return -1;
+	}
+	for (i = 0; i < a.n; i++) {
+		const cmp_result_t *y = cmp_find(&b, a.r + i);
+		if (y && a.r[i].n > 1 && y->n > 1) m++;
+	}
+	/* Bonferroni */
+	alpha = 0.05 / (m ? m : 1);
+	printf("A: %s\nB: %s\nspeedup of B, %g%% confidence interval "
+			"(95%% for %d results), threshold %g%%:\n\n"
+			"section          name                      size"
+			"     A ms     B ms  speedup      interval\n",
+			fa, fb, 100 - alpha * 100, m, thr * 100);
+	for (i = 0; i < a.n; i++) {
+		const cmp_result_t *x = a.r + i, *y = cmp_find(&b, x);
+		double sp, lo, hi, ma, va, mb, vb;
+		const char *flag = "";
+		if (!y || !x->n || !y->n) continue;
+		if (cmp_speedup(x, y, 0.05, &sp, &lo, &hi)) {
+			if (hi < 1 - thr) raw[1]++;
+			else if (lo > 1 + thr) raw[0]++;
+			cmp_speedup(x, y, alpha, &sp, &lo, &hi);
+			if (hi < 1 - thr) flag = "  REGRESSION", cor[1]++;
+			else if (lo > 1 + thr) flag = "  faster", cor[0]++;
+			else nsame++;
+		} else flag = "  (too few samples)";
+		cmp_logstat(x, &ma, &va);
+		cmp_logstat(y, &mb, &vb);
+		printf("%-16s %-20s %9.0f %8.3f %8.3f %7.3fx  [%.3f, %.3f]%s\n",
+				x->section, x->name, x->size, exp(ma) * 1e-6, exp(mb) * 1e-6,
+				sp, lo, hi, flag);
+	}
+	printf("\nuncorrected (95%% for each): %d faster, %d slower\n"
+			"corrected: %d faster, %d slower, %d within the noise\n",
+			raw[0], raw[1], cor[0], cor[1], nsame);
+	if (svg) cmp_svg(svg, &a, &b);
+	cmp_free(&a); cmp_free(&b);
+	return cor[1];
+}
@@ -0,0 +1,56 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "crzy64.hpp"
+
+/* the C++ layer against direct calls, per call latency */
+
+static volatile std::size_t sink;
+
+template <class F>
+static double bench(std::size_t nrep, F &&fn) {
+	double best = 0;
+	for (int r = 0; r < 5; r++) {
+		auto t0 = std::chrono::steady_clock::now();
+		for (std::size_t i = 0; i < nrep; i++) fn();
+		auto t1 = std::chrono::steady_clock::now();
+		double t = std::chrono::duration<double, std::nano>(t1 - t0).count() / nrep;
+		if (!r || t < best) best = t;
+	}
+	return best;
+}
+
+int main(int argc, char **argv) {
+	static const std::size_t sizes[] = { 16, 64, 256, 4096, 65536 };
+	std::size_t total = argc > 1 ? std::atoi(argv[1]) << 20 : 64 << 20;
+	std::vector<std::uint8_t> src(65536), enc(crzy64::encoded_size(65536));
+	std::string str;
+
+	for (std::size_t i = 0; i < src.size(); i++) src[i] = i ^ 0x55;
+	str.reserve(enc.size());
+
+	std::printf("%6s %11s %11s %11s %11s %11s\n", "size", "C encode",
+			"C++ encode", "C++ append", "C decode", "C++ decode");
+	for (std::size_t n : sizes) {
+		std::size_t nrep = total / n, m = crzy64::encoded_size(n);
+		auto s = std::as_bytes(std::span(src.data(), n));
+		std::span<char> d((char*)enc.data(), enc.size());
+		crzy64_encode(enc.data(), src.data(), n);
+		std::string_view e((const char*)enc.data(), m);
+
+		double t0 = bench(nrep, [&] { sink = crzy64_encode(enc.data(), src.data(), n); });
+		double t1 = bench(nrep, [&] { sink = crzy64::encode(s, d); });
+		double t2 = bench(nrep, [&] { str.clear(); sink = crzy64::encode_append(str, s); });
+		double t3 = bench(nrep, [&] { sink = crzy64_decode(src.data(), enc.data(), m); });
+		double t4 = bench(nrep, [&] {
+			sink = crzy64::decode(e, std::as_writable_bytes(std::span(src.data(), n)));
+		});
+		std::printf("%6zu %8.1f ns %8.1f ns %8.1f ns %8.1f ns %8.1f ns\n",
+				n, t0, t1, t2, t3, t4);
+	}
+	return 0;
+}
@@ -0,0 +1,144 @@
+
+/* Hardware counters with perf_event_open(), user space only,
+ * so it works with perf_event_paranoid up to 2. Events that
+ * can't be opened are skipped. */
+
+#define BENCH_PERF_EVENTS 7
+
+typedef struct {
+	int fd[BENCH_PERF_EVENTS];
+	int count;
+	/* per sample, -1 if not available */
+	double val[BENCH_PERF_EVENTS];
+} bench_perf_t;
+
+static const char * const bench_perf_names[BENCH_PERF_EVENTS] = {
+	"cycles", "instructions", "l1d_misses", "llc_misses",
+	"branch_misses", "uops", "page_faults"
+};
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+static int bench_perf_event(int type, uint64_t config) {
+	struct perf_event_attr a;
+	memset(&a, 0, sizeof(a));
+	a.size = sizeof(a);
+	a.type = type;
+	a.config = config;
+	a.disabled = 1;
+	a.exclude_kernel = 1;
+	a.exclude_hv = 1;
+	a.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+			PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return syscall(__NR_perf_event_open, &a, 0, -1, -1, 0);
+}
+
+/* Returns the number of opened events. */
+static int bench_perf_open(bench_perf_t *p) {
+#define CACHE_MISS(x) (PERF_COUNT_HW_CACHE_##x | \
+	PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+	static const struct { int type; uint64_t config; } ev[] = {
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+		{ PERF_TYPE_HW_CACHE, CACHE_MISS(L1D) },
+		{ PERF_TYPE_HW_CACHE, CACHE_MISS(LL) },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+		{ PERF_TYPE_RAW, 0 },
+		{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS }
+	};
+#undef CACHE_MISS
+	char buf[256]; FILE *f;
+	uint64_t uops = 0;
+	int i;
+
+	/* retired uops have no generic event */
+	if ((f = fopen("/proc/cpuinfo", "r"))) {
+		while (fgets(buf, sizeof(buf), f))
+			if (!strncmp(buf, "vendor_id", 9)) {
+				if (strstr(buf, "GenuineIntel")) uops = 0x01c2;
+				else if (strstr(buf, "AuthenticAMD")) uops = 0x00c1;
+				break;
+			}
+		fclose(f);
+	}
+
+	p->count = 0;
+	for (i = 0; i < BENCH_PERF_EVENTS; i++) {
+		p->val[i] = -1;
+		p->fd[i] = -1;
+		if (ev[i].type == PERF_TYPE_RAW && !uops) continue;
+		p->fd[i] = bench_perf_event(ev[i].type,
+				ev[i].type == PERF_TYPE_RAW ? uops : ev[i].config);
+		if (p->fd[i] >= 0) p->count++;
+	}
+	return p->count;
+}
+
+static void bench_perf_start(bench_perf_t *p) {
+	int i;
+	for (i = 0; i < BENCH_PERF_EVENTS; i++)
+		if (p->fd[i] >= 0) {
+			ioctl(p->fd[i], PERF_EVENT_IOC_RESET, 0);
+			ioctl(p->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+		}
+}
+
+/* Keeps the counts, for work that isn't part of the sample. */
+static void bench_perf_pause(bench_perf_t *p, int pause) {
+	int i;
+	for (i = 0; i < BENCH_PERF_EVENTS; i++)
+		if (p->fd[i] >= 0) ioctl(p->fd[i], pause ?
+				PERF_EVENT_IOC_DISABLE : PERF_EVENT_IOC_ENABLE, 0);
+}
+
+/* Reads the counters divided by (n), scaled if multiplexed. */
+static void bench_perf_stop(bench_perf_t *p, unsigned n) {
+	uint64_t v[3];
+	int i;
+	for (i = 0; i < BENCH_PERF_EVENTS; i++) {
+		if (p->fd[i] < 0) continue;
+		ioctl(p->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+		p->val[i] = -1;
+		if (read(p->fd[i], v, sizeof(v)) == sizeof(v) && v[2])
+			p->val[i] = (double)v[0] * v[1] / v[2] / n;
+	}
+}
+
+static void bench_perf_close(bench_perf_t *p) {
+	int i;
+	for (i = 0; i < BENCH_PERF_EVENTS; i++)
+		if (p->fd[i] >= 0) close(p->fd[i]);
+	p->count = 0;
+}
+#else
+static int bench_perf_open(bench_perf_t *p) {
+	int i;
+	for (i = 0; i < BENCH_PERF_EVENTS; i++) p->fd[i] = -1, p->val[i] = -1;
+	return p->count = 0;
+}
+#define bench_perf_start(p) (void)(p)
+#define bench_perf_pause(p, pause) (void)(p)
+#define bench_perf_stop(p, n) (void)(p)
+#define bench_perf_close(p) (void)(p)
+#endif
+
+/* Prints cycles/byte, IPC and misses per KB for (bytes) per sample. */
+static void bench_perf_print(const bench_perf_t *p, double bytes) {
+	const double *v = p->val;
+	const char *sep = "  ";
+	if (!p->count) return;
+#define PERF_PRINT(cond, ...) \
+	if (cond) printf("%s", sep), printf(__VA_ARGS__), sep = ", ";
+	PERF_PRINT(v[0] >= 0 && bytes, "%.3f cycles/B", v[0] / bytes)
+	PERF_PRINT(v[0] > 0 && v[1] >= 0, "IPC %.2f", v[1] / v[0])
+	PERF_PRINT(v[5] >= 0 && bytes, "%.2f uops/B", v[5] / bytes)
+	PERF_PRINT(v[2] >= 0 && bytes, "L1D %.2f/KB", v[2] * 1024 / bytes)
+	PERF_PRINT(v[3] >= 0 && bytes, "LLC %.2f/KB", v[3] * 1024 / bytes)
+	PERF_PRINT(v[4] >= 0 && bytes, "br-miss %.3f/KB", v[4] * 1024 / bytes)
+	PERF_PRINT(v[6] >= 0 && bytes, "faults %.3f/KB", v[6] * 1024 / bytes)
+#undef PERF_PRINT
+	if (*sep != ' ') printf("\n");
+}
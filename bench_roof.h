@@ -0,0 +1,108 @@
+
+/* Read, write and copy bandwidth at every cache level from sysfs and
+ * in memory, to show the results as a fraction of the achievable. */
+
+#define BENCH_LEVELS 5
+
+typedef struct {
+	/* levels, the last one is memory */
+	int n;
+	char name[BENCH_LEVELS][8];
+	/* cache size, working set for memory */
+	size_t size[BENCH_LEVELS];
+	/* MB/s */
+	double read[BENCH_LEVELS], write[BENCH_LEVELS], copy[BENCH_LEVELS];
+} bench_roof_t;
+
+static volatile uint64_t bench_roof_sink;
+
+#ifdef __GNUC__
+/* to use the widest loads */
+typedef uint64_t bench_roof_vec __attribute__((vector_size(32), aligned(1)));
+#else
+typedef uint64_t bench_roof_vec;
+#endif
+
+static void bench_roof_read(const uint8_t *p, size_t n) {
+	const bench_roof_vec *s = (const bench_roof_vec*)p;
+	bench_roof_vec a, b, c, d;
+	uint64_t x;
+	size_t i;
+	memset(&a, 0, sizeof(a)); b = c = d = a;
+	for (i = 0; i + 4 <= n / sizeof(a); i += 4)
+		a ^= s[i], b ^= s[i + 1], c ^= s[i + 2], d ^= s[i + 3];
+	a ^= b ^ c ^ d;
+	memcpy(&x, &a, sizeof(x));
+	bench_roof_sink = x;
+}
+
+/* 0 - read, 1 - write, 2 - copy of (n) bytes, MB/s, the best of (nrep) */
+static double bench_roof_run(int op, uint8_t *buf, size_t n,
+		int64_t (*timer)(void), double freq, unsigned nrep) {
+	size_t total = 64 << 20, k, nn = (total + n - 1) / n;
+	int64_t t, best = 0;
+	unsigned r;
+	for (r = 0; r <= nrep; r++) {
+		t = timer();
+		for (k = 0; k < nn; k++)
+			if (op == 0) bench_roof_read(buf, n);
+			else if (op == 1) memset(buf, (int)k, n);
+			else memcpy(buf + n, buf, n);
+		t = timer() - t;
+		/* the first is a warmup */
+		if (r == 1 || (r > 1 && t < best)) best = t;
+	}
+	return (double)n * nn * freq / best / (1 << 20);
+}
+
+/* Measures at half of every data cache and at (msize) bytes
+ * of (buf), copies use two halves of the working set. */
+static void bench_roof_init(bench_roof_t *r, int cpu, uint8_t *buf,
+		size_t msize, int64_t (*timer)(void), double freq, unsigned nrep) {
+	char tmp[32], fmt[64];
+	int i;
+	if (cpu < 0) cpu = 0;
+	r->n = 0;
+	for (i = 0; i < 10 && r->n < BENCH_LEVELS - 1; i++) {
+		size_t size = bench_cache_size(cpu, i);
+		if (!size) break;
+		snprintf(fmt, sizeof(fmt),
+				"/sys/devices/system/cpu/cpu%%d/cache/index%d/type", i);
+		if (!strcmp(bench_sysfs(tmp, sizeof(tmp), fmt, cpu), "Instruction"))
+			continue;
+		snprintf(fmt, sizeof(fmt),
+				"/sys/devices/system/cpu/cpu%%d/cache/index%d/level", i);
+		snprintf(r->name[r->n], sizeof(r->name[0]), "L%d",
+				atoi(bench_sysfs(tmp, sizeof(tmp), fmt, cpu)) & 15);
+		r->size[r->n++] = size;
+	}
+	strcpy(r->name[r->n], "mem");
+	r->size[r->n++] = msize;
+	for (i = 0; i < r->n; i++) {
+		size_t ws = i < r->n - 1 ? r->size[i] / 2 : msize;
+		if (ws > msize) ws = msize;
+		r->read[i] = bench_roof_run(0, buf, ws, timer, freq, nrep);
+		r->write[i] = bench_roof_run(1, buf, ws, timer, freq, nrep);
+		r->copy[i] = bench_roof_run(2, buf, ws / 2, timer, freq, nrep);
+	}
+}
+
+/* The level that holds the working set. */
+static int bench_roof_level(const bench_roof_t *r, double ws) {
+	int i;
+	for (i = 0; i < r->n - 1; i++)
+		if (ws <= r->size[i]) break;
+	return i;
+}
+
+/* Prints (mbps) as a percentage of copy bandwidth for the level,
+ * scaled by (traffic) bytes read and written per byte. */
+static void bench_roof_print(const bench_roof_t *r,
+		double ws, double traffic, double mbps) {
+	int i;
+	if (r->n) {
+		i = bench_roof_level(r, ws);
+		printf(" (%.0f%% of %s)", mbps * traffic / 2 / r->copy[i] * 100, r->name[i]);
+	}
+	printf("\n");
+}
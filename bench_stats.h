@@ -0,0 +1,224 @@
+
+/* Statistics over repeated runs and machine-readable output,
+ * include after bench_perf.h. */
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+typedef struct {
+	double min, p10, median, p90, mean, stddev;
+} bench_summary_t;
+
+static int bench_cmp(const void *a, const void *b) {
+	int64_t x = *(const int64_t*)a, y = *(const int64_t*)b;
+	return (x > y) - (x < y);
+}
+
+static double bench_percentile(const int64_t *t, unsigned n, double p) {
+	double x = p * (n - 1);
+	unsigned i = x;
+	if (i + 1 >= n) return t[n - 1];
+	return t[i] + (t[i + 1] - t[i]) * (x - i);
+}
+
+static void bench_summary(bench_summary_t *r, const int64_t *t, unsigned n) {
+	int64_t *a = (int64_t*)malloc(n * sizeof(*a));
+	double sum = 0, sq = 0;
+	unsigned i;
+	memset(r, 0, sizeof(*r));
+	if (!n || !a) { free(a); return; }
+	memcpy(a, t, n * sizeof(*a));
+	qsort(a, n, sizeof(*a), bench_cmp);
+	for (i = 0; i < n; i++) sum += a[i];
+	r->mean = sum / n;
+	for (i = 0; i < n; i++) sq += (a[i] - r->mean) * (a[i] - r->mean);
+	r->stddev = n > 1 ? sqrt(sq / (n - 1)) : 0;
+	r->min = a[0];
+	r->p10 = bench_percentile(a, n, 0.1);
+	r->median = bench_percentile(a, n, 0.5);
+	r->p90 = bench_percentile(a, n, 0.9);
+	free(a);
+}
+
+typedef struct {
+	FILE *json, *csv;
+	const char *section;
+	double freq;
+	int count;
+} bench_out_t;
+
+static void bench_out_open(bench_out_t *o, const char *json, const char *csv,
+		double freq, const char *config) {
+	o->json = json ? fopen(json, "w") : NULL;
+	o->csv = csv ? fopen(csv, "w") : NULL;
+	o->section = "";
+	o->freq = freq;
+	o->count = 0;
+	if (o->json)
+		fprintf(o->json, "{\n\"config\": {%s},\n\"results\": [", config);
+	if (o->csv)
+		fprintf(o->csv, "section,name,size,bytes,calls,samples,"
+				"min_ns,p10_ns,median_ns,p90_ns,mean_ns,stddev_ns,"
+				"best_mbps,median_mbps");
+	if (o->csv) {
+		int i;
+		for (i = 0; i < BENCH_PERF_EVENTS; i++)
+			fprintf(o->csv, ",%s", bench_perf_names[i]);
+		fprintf(o->csv, "\n");
+	}
+}
+
+/* (bytes) and (calls) are per sample, zero if not applicable */
+static void bench_record(bench_out_t *o, const char *name, double size,
+		double bytes, double calls, const int64_t *t, unsigned n,
+		const bench_perf_t *perf) {
+	bench_summary_t r; double ns = 1e9 / o->freq;
+	double best = 0, med = 0;
+	unsigned i;
+	if (!o->json && !o->csv) return;
+	bench_summary(&r, t, n);
+	if (bytes && r.min) best = bytes * o->freq / r.min / (1 << 20);
+	if (bytes && r.median) med = bytes * o->freq / r.median / (1 << 20);
+	if (o->json) {
+		fprintf(o->json, "%s\n{\"section\": \"%s\", \"name\": \"%s\", "
+				"\"size\": %.0f, \"bytes\": %.0f, \"calls\": %.0f,\n"
+				" \"min_ns\": %.1f, \"p10_ns\": %.1f, \"median_ns\": %.1f, "
+				"\"p90_ns\": %.1f, \"mean_ns\": %.1f, \"stddev_ns\": %.1f,\n"
+				" \"best_mbps\": %.2f, \"median_mbps\": %.2f,\n \"samples_ns\": [",
+				o->count ? "," : "", o->section, name, size, bytes, calls,
+				r.min * ns, r.p10 * ns, r.median * ns, r.p90 * ns,
+				r.mean * ns, r.stddev * ns, best, med);
+		for (i = 0; i < n; i++)
+			fprintf(o->json, "%s%.1f", i ? ", " : "", t[i] * ns);
+		fprintf(o->json, "]");
+		if (perf && perf->count) {
+			const char *sep = ",\n \"perf\": {";
+			for (i = 0; i < BENCH_PERF_EVENTS; i++)
+				if (perf->val[i] >= 0) {
+					fprintf(o->json, "%s\"%s\": %.1f", sep,
+							bench_perf_names[i], perf->val[i]);
+					sep = ", ";
+				}
+			if (*sep == ',' && sep[1] == ' ') fprintf(o->json, "}");
+		}
+		fprintf(o->json, "}");
+	}
+	if (o->csv) {
+		fprintf(o->csv, "%s,%s,%.0f,%.0f,%.0f,%u,"
+				"%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.2f,%.2f",
+				o->section, name, size, bytes, calls, n,
+				r.min * ns, r.p10 * ns, r.median * ns, r.p90 * ns,
+				r.mean * ns, r.stddev * ns, best, med);
+		for (i = 0; i < BENCH_PERF_EVENTS; i++)
+			if (perf && perf->count && perf->val[i] >= 0)
+				fprintf(o->csv, ",%.1f", perf->val[i]);
+			else fprintf(o->csv, ",");
+		fprintf(o->csv, "\n");
+	}
+	o->count++;
+}
+
+static void bench_out_close(bench_out_t *o, double drift) {
+	if (o->json) {
+		fprintf(o->json, "\n],\n\"freq_drift\": %.4f\n}\n", drift);
+		fclose(o->json);
+	}
+	if (o->csv) fclose(o->csv);
+}
+
+/* Pins the thread to the CPU, or to the current one if (cpu) < 0.
+ * Returns the CPU number or -1. */
+static int bench_pin(int cpu) {
+#ifdef __linux__
+	cpu_set_t set;
+	if (cpu < 0 && (cpu = sched_getcpu()) < 0) return -1;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set)) return -1;
+	return cpu;
+#else
+	(void)cpu;
+	return -1;
+#endif
+}
+
+/* Reads the first line of a sysfs file, empty string if missing. */
+static const char *bench_sysfs(char *buf, size_t size, const char *fmt, int cpu) {
+	char fn[128]; FILE *f; size_t n;
+	buf[0] = 0;
+	snprintf(fn, sizeof(fn), fmt, cpu);
+	if ((f = fopen(fn, "r"))) {
+		if (!fgets(buf, size, f)) buf[0] = 0;
+		fclose(f);
+	}
+	n = strlen(buf);
+	if (n && buf[n - 1] == '\n') buf[n - 1] = 0;
+	return buf;
+}
+
+/* Size of the cache at sysfs (index) for the CPU, 0 if unknown. */
+static size_t bench_cache_size(int cpu, int index) {
+	char buf[32], fmt[64]; char *e; size_t n;
+	snprintf(fmt, sizeof(fmt),
+			"/sys/devices/system/cpu/cpu%%d/cache/index%d/size", index);
+	n = strtoul(bench_sysfs(buf, sizeof(buf), fmt, cpu < 0 ? 0 : cpu), &e, 10);
+	if (*e == 'K') n <<= 10;
+	else if (*e == 'M') n <<= 20;
+	return n;
+}
+
+/* Lists the allowed CPUs, the first thread of each core goes first,
+ * then the SMT siblings. Call before pinning. Returns the number. */
+static int bench_cpus(int *cpus, int max) {
+#ifdef __linux__
+	cpu_set_t set; char buf[64];
+	int i, n = 0, pass;
+	if (sched_getaffinity(0, sizeof(set), &set)) return 0;
+	for (pass = 0; pass < 2; pass++)
+	for (i = 0; i < CPU_SETSIZE && n < max; i++) {
+		if (!CPU_ISSET(i, &set)) continue;
+		bench_sysfs(buf, sizeof(buf),
+				"/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", i);
+		if ((!buf[0] || atoi(buf) == i) == !pass) cpus[n++] = i;
+	}
+	return n;
+#else
+	(void)cpus; (void)max;
+	return 0;
+#endif
+}
+
+/* Timer ticks of a timer call, the best of 5 runs of 1000 calls. */
+static double bench_timer_cost(int64_t (*timer)(void)) {
+	int64_t t, best = 0;
+	int i, j;
+	for (j = 0; j < 5; j++) {
+		t = timer();
+		for (i = 0; i < 1000; i++) timer();
+		t = timer() - t;
+		if (!j || t < best) best = t;
+	}
+	return best / 1001.0;
+}
+
+/* Timer ticks for a chain of dependent multiplications, which
+ * doesn't depend on memory, so the ratio of two measurements
+ * shows the change of the core frequency. */
+static int64_t bench_spin(int64_t (*timer)(void)) {
+	int64_t t, best = 0;
+	uint64_t x = 1;
+	int i, j;
+	for (j = 0; j < 5; j++) {
+		t = timer();
+		for (i = 0; i < 1 << 22; i++) {
+			x = x * 0x9e3779b97f4a7c15 + 1;
+#ifdef __GNUC__
+			__asm__ __volatile__("" : "+r"(x));
+#endif
+		}
+		t = timer() - t;
+		if (!j || t < best) best = t;
+	}
+	return best + (x == 42);
+}
@@ -5,6 +5,10 @@ typedef struct {
 	int y0, y1, ym;
 	int w, h;
 	FILE *f;
+	/* linear x axis labeled every xstep points, log2 if zero */
+	int xstep;
+	/* the value at the x axis, if labels and values are in the same units */
+	float ybase;
 } svg_writer_t;
 
 static int svg_start(svg_writer_t *s, const char *fn,
@@ -25,13 +29,19 @@ static int svg_start(svg_writer_t *s, const char *fn,
 
 	for (i = 0; i <= s->ny; i++) {
 		int y = s->h - s->y0 - i * s->ym;
-		double l = i * mul;
+		double l = s->ybase + i * mul;
 		fprintf(f, "<path stroke='gray' d='M %d %d h %d'/>\n",
 				s->x0, y, s->nx * s->xm);
 		fprintf(f, "<text x='%d' y='%d'>%g%s</text>\n",
 				s->x0 / 2, y, l, unit);
 	}
 
+	if (s->xstep)
+	for (i = 0; i <= s->nx; i += s->xstep) {
+		fprintf(f, "<text x='%d' y='%d'>%d</text>\n",
+				s->x0 + i * s->xm, s->h - s->y0 / 2, i);
+	}
+	else
 	for (i = 0; i <= s->nx; i += 2) {
 		fprintf(f, "<text x='%d' y='%d'>%d%s</text>\n",
 				s->x0 + i * s->xm, s->h - s->y0 / 2,
@@ -46,23 +56,36 @@ static void svg_graph(svg_writer_t *s, const char *clr,
 	if (!s->f) return;
 	mul *= s->ym;
 
-	fprintf(s->f, "<g fill='%s'>\n", clr);
-	for (i = 0; i <= s->nx; i++) {
-		double y = s->h - s->y0 - arr[i] * mul;
-		fprintf(s->f, "<circle cx='%d' cy='%.2f' r='4'/>\n",
-				s->x0 + i * s->xm, y);
+	/* too dense for markers */
+	if (s->xm >= 8) {
+		fprintf(s->f, "<g fill='%s'>\n", clr);
+		for (i = 0; i <= s->nx; i++) {
+			double y = s->h - s->y0 - (arr[i] - s->ybase) * mul;
+			fprintf(s->f, "<circle cx='%d' cy='%.2f' r='4'/>\n",
+					s->x0 + i * s->xm, y);
+		}
+		fprintf(s->f, "</g>\n");
 	}
-	fprintf(s->f, "</g>\n");
 
 	fprintf(s->f, "<path stroke='%s' stroke-width='2' d='", clr);
 	for (i = 0; i <= s->nx; i++) {
-		double y = s->h - s->y0 - arr[i] * mul;
+		double y = s->h - s->y0 - (arr[i] - s->ybase) * mul;
 		fprintf(s->f, "%s %d %.2f",
 				i ? " L" : "M", s->x0 + i * s->xm, y);
 	}
 	fprintf(s->f, "'/>\n");
 }
 
+/* a dashed vertical line at (x) in points */
+static void svg_vline(svg_writer_t *s, double x, const char *label) {
+	double px = s->x0 + x * s->xm;
+	if (!s->f || x < 0 || x > s->nx) return;
+	fprintf(s->f, "<path stroke='gray' stroke-dasharray='4' d='M %.1f %d v %d'/>\n",
+			px, s->h - s->y0, -s->ny * s->ym);
+	fprintf(s->f, "<text x='%.1f' y='%d'>%s</text>\n",
+			px, s->h - s->y0 - s->ny * s->ym - 12, label);
+}
+
 static void svg_end(svg_writer_t *s) {
 	if (s->f) {
 		fprintf(s->f, "</svg>");
@@ -31,6 +31,13 @@
 #define CRZY64_H
 
 #include <stdint.h>
+#include <string.h>
+
+/* tuned parameters, e.g. -DCRZY64_CONFIG='"crzy64_config.h"'
+ * with the header from "make tune" */
+#ifdef CRZY64_CONFIG
+#include CRZY64_CONFIG
+#endif
 
 #ifndef CRZY64_ATTR
 #define CRZY64_ATTR
@@ -82,6 +89,33 @@
 #endif
 #endif
 
+/* lets the C++ wrapper evaluate the scalar code at compile time */
+#ifndef CRZY64_CONSTEXPR
+#if defined(__cplusplus) && __cplusplus >= 201402L
+#define CRZY64_CONSTEXPR constexpr
+#else
+#define CRZY64_CONSTEXPR
+#endif
+#endif
+
+#ifndef CRZY64_ALWAYS_INLINE
+#ifdef __GNUC__
+#define CRZY64_ALWAYS_INLINE __inline__ __attribute__((always_inline))
+#else
+#define CRZY64_ALWAYS_INLINE CRZY64_INLINE
+#endif
+#endif
+
+#ifndef CRZY64_UNROLL_ALL
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 8
+#define CRZY64_UNROLL_ALL _Pragma("GCC unroll 16")
+#elif defined(__clang__)
+#define CRZY64_UNROLL_ALL _Pragma("unroll")
+#else
+#define CRZY64_UNROLL_ALL
+#endif
+#endif
+
 #ifndef CRZY64_RESTRICT
 #ifdef __GNUC__
 #define CRZY64_RESTRICT __restrict__
@@ -98,6 +132,18 @@
 #endif
 #endif
 
+/* bytes to prefetch ahead of the input, 0 - no prefetch */
+#ifndef CRZY64_PREFETCH_DIST
+#define CRZY64_PREFETCH_DIST 1024
+#endif
+
+#if CRZY64_PREFETCH_DIST
+#define CRZY64_PREFETCH_AHEAD(p, end) CRZY64_PREFETCH( \
+	(p) + CRZY64_PREFETCH_DIST < (end) ? (p) + CRZY64_PREFETCH_DIST : (end))
+#else
+#define CRZY64_PREFETCH_AHEAD(p, end) (void)0
+#endif
+
 #if CRZY64_VEC
 #if CRZY64_NEON
 #include <arm_neon.h>
@@ -131,8 +177,203 @@
 #endif
 #endif
 
+/* USDT probes, compiled in with CRZY64_USDT=1 if <sys/sdt.h> is found:
+ * crzy64:encode_entry(n, path), crzy64:encode_return(size)
+ * crzy64:decode_entry(n, path), crzy64:decode_return(size)
+ * The path is the first loop that runs for the size. */
+#ifndef CRZY64_USDT
+#define CRZY64_USDT 0
+#endif
+
+#if CRZY64_USDT && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define CRZY64_HAS_USDT 1
+#define CRZY64_PROBE1(name, a) STAP_PROBE1(crzy64, name, a)
+#define CRZY64_PROBE2(name, a, b) STAP_PROBE2(crzy64, name, a, b)
+#endif
+#endif
+
+#ifndef CRZY64_HAS_USDT
+#define CRZY64_HAS_USDT 0
+#define CRZY64_PROBE1(name, a)
+#define CRZY64_PROBE2(name, a, b)
+#endif
+
+#define CRZY64_PATH_TAIL 0
+#define CRZY64_PATH_SCALAR 1
+#define CRZY64_PATH_FAST64 2
+#define CRZY64_PATH_VEC 3
+/* only for stats, the unrolled vector or FAST64 loop */
+#define CRZY64_PATH_UNROLL 4
+
+#if !CRZY64_VEC
+#define CRZY64_VEC_ENC_MIN ((size_t)-1)
+#define CRZY64_VEC_DEC_MIN ((size_t)-1)
+#elif !CRZY64_NEON && defined(__AVX2__)
+#define CRZY64_VEC_ENC_MIN 24
+#define CRZY64_VEC_DEC_MIN 32
+#else
+#define CRZY64_VEC_ENC_MIN 12
+#define CRZY64_VEC_DEC_MIN 16
+#endif
+
+#define CRZY64_PATH(n, vec, fast64, scalar) ( \
+	(n) >= (vec) ? CRZY64_PATH_VEC : \
+	CRZY64_FAST64 && (n) >= (fast64) ? CRZY64_PATH_FAST64 : \
+	(n) >= (scalar) ? CRZY64_PATH_SCALAR : CRZY64_PATH_TAIL)
+#define CRZY64_ENC_PATH(n) CRZY64_PATH(n, CRZY64_VEC_ENC_MIN, 6, 3)
+#define CRZY64_DEC_PATH(n) CRZY64_PATH(n, CRZY64_VEC_DEC_MIN, 8, 4)
+
+#ifndef CRZY64_TLS
+#if defined(__cplusplus)
+#define CRZY64_TLS thread_local
+#elif defined(_MSC_VER)
+#define CRZY64_TLS __declspec(thread)
+#elif __STDC_VERSION__ >= 201112L
+#define CRZY64_TLS _Thread_local
+#else
+#define CRZY64_TLS __thread
+#endif
+#endif
+
+/* for the state of the functions, which are inline in C++ and can
+ * be linked from many translation units, so it must be one too */
+#ifndef CRZY64_STATIC
+#if defined(__cplusplus) && __cplusplus >= 201703L
+#define CRZY64_STATIC inline
+#else
+#define CRZY64_STATIC static
+#endif
+#endif
+
+#ifndef CRZY64_STATS
+#define CRZY64_STATS 0
+#endif
+
+#if CRZY64_STATS
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Per-thread counters of calls and input bytes (characters for
+ * decoding) by stage, and a histogram of call sizes by bit length.
+ * The counters of all threads are linked in a list and summed by
+ * crzy64_stats_sum(), reading them from other threads isn't
+ * synchronized. In C each translation unit has its own counters,
+ * in C++17 and later they are shared by the program. */
+typedef struct crzy64_stats {
+	uint64_t calls[2][5], bytes[2][5];
+	uint64_t hist[2][65];
+	struct crzy64_stats *next;
+} crzy64_stats_t;
+
+CRZY64_STATIC CRZY64_TLS crzy64_stats_t *crzy64_stats_tls;
+CRZY64_STATIC crzy64_stats_t *crzy64_stats_list, crzy64_stats_lost;
+
+CRZY64_ATTR
+crzy64_stats_t *crzy64_stats_new(void) {
+	crzy64_stats_t *st = (crzy64_stats_t*)calloc(1, sizeof(*st));
+	if (!st) return &crzy64_stats_lost;
+#ifdef __GNUC__
+	st->next = __atomic_load_n(&crzy64_stats_list, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&crzy64_stats_list, &st->next, st,
+			1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+#else
+	st->next = crzy64_stats_list;
+	crzy64_stats_list = st;
+#endif
+	return crzy64_stats_tls = st;
+}
+
+static CRZY64_INLINE crzy64_stats_t *crzy64_stats_enter(int op, size_t n) {
+	crzy64_stats_t *st = crzy64_stats_tls;
+	unsigned i = 0;
+	if (!st) st = crzy64_stats_new();
+#ifdef __GNUC__
+	if (n) i = sizeof(long long) * 8 - __builtin_clzll(n);
+#else
+	while (n >> i) i++;
+#endif
+	st->hist[op][i]++;
+	return st;
+}
+
+#define CRZY64_STATS_ENTER(op) \
+	crzy64_stats_t *crzy64_st = crzy64_stats_enter(op, n); \
+	size_t crzy64_sn = n;
+/* counts the input consumed since the previous mark */
+#define CRZY64_STATS_MARK(op, stage) do { \
+	if (crzy64_sn != n) { \
+		crzy64_st->calls[op][stage]++; \
+		crzy64_st->bytes[op][stage] += crzy64_sn - n; \
+		crzy64_sn = n; \
+	} \
+} while (0)
+/* counts the rest of the input */
+#define CRZY64_STATS_REST(op, stage) do { \
+	if (crzy64_sn) { \
+		crzy64_st->calls[op][stage]++; \
+		crzy64_st->bytes[op][stage] += crzy64_sn; \
+	} \
+} while (0)
+
+/* Sums the counters of all threads. */
+CRZY64_ATTR
+void crzy64_stats_sum(crzy64_stats_t *r) {
+	const crzy64_stats_t *st;
+	int op, i;
+	memset(r, 0, sizeof(*r));
+#ifdef __GNUC__
+	st = __atomic_load_n(&crzy64_stats_list, __ATOMIC_ACQUIRE);
+#else
+	st = crzy64_stats_list;
+#endif
+	for (;; st = st->next) {
+		if (!st) st = &crzy64_stats_lost;
+		for (op = 0; op < 2; op++) {
+			for (i = 0; i < 5; i++) {
+				r->calls[op][i] += st->calls[op][i];
+				r->bytes[op][i] += st->bytes[op][i];
+			}
+			for (i = 0; i < 65; i++) r->hist[op][i] += st->hist[op][i];
+		}
+		if (st == &crzy64_stats_lost) break;
+	}
+}
+
+CRZY64_ATTR
+void crzy64_stats_dump(FILE *f) {
+	static const char * const names[] = {
+		"tail", "scalar", "fast64", "vector", "unrolled" };
+	crzy64_stats_t r;
+	uint64_t total;
+	int op, i, k;
+
+	crzy64_stats_sum(&r);
+	for (op = 0; op < 2; op++) {
+		for (total = i = 0; i < 5; i++) total += r.bytes[op][i];
+		fprintf(f, "%s: %llu bytes\n", op ? "decode" : "encode",
+				(unsigned long long)total);
+		if (!total) continue;
+		for (i = 0; i < 5; i++)
+			fprintf(f, "  %-8s %12llu calls %14llu bytes %5.1f%%\n", names[i],
+					(unsigned long long)r.calls[op][i],
+					(unsigned long long)r.bytes[op][i],
+					r.bytes[op][i] * 100.0 / total);
+		for (k = 65; k > 0 && !r.hist[op][k - 1]; k--);
+		for (i = 0; i < k; i++)
+			fprintf(f, "  %2d-bit size %9llu calls\n", i,
+					(unsigned long long)r.hist[op][i]);
+	}
+}
+#else
+#define CRZY64_STATS_ENTER(op)
+#define CRZY64_STATS_MARK(op, stage)
+#define CRZY64_STATS_REST(op, stage)
+#endif
+
 /* 24 -> 6x4 */
-static CRZY64_INLINE uint32_t crzy64_unpack(uint32_t a) {
+static CRZY64_CONSTEXPR CRZY64_INLINE uint32_t crzy64_unpack(uint32_t a) {
 	uint32_t b = a << 6, m;
 	b &= m = 0xfcf0c0 << 6;
 	a &=     0x030f3f;
@@ -187,6 +428,8 @@ CRZY64_ATTR
 size_t crzy64_encode(uint8_t *CRZY64_RESTRICT d,
 		const uint8_t *CRZY64_RESTRICT s, size_t n) {
 	uint8_t *d0 = d; uint32_t a, b, c;
+	CRZY64_STATS_ENTER(0)
+	CRZY64_PROBE2(encode_entry, n, CRZY64_ENC_PATH(n));
 
 #if CRZY64_VEC && CRZY64_NEON
 	if (n >= 12) {
@@ -240,7 +483,7 @@ size_t crzy64_encode(uint8_t *CRZY64_RESTRICT d,
 			uint8x16x3_t q0 = vld3q_u8(s);
 			uint8x16x4_t q1; uint8x16_t u, v;
 
-			CRZY64_PREFETCH(s + 1024 < end ? s + 1024 : end);
+			CRZY64_PREFETCH_AHEAD(s, end);
 			u = vshrq_n_u8(q0.val[0], 2);
 			v = vshlq_n_u8(q0.val[2], 2);
 			c = veorq_u8(q0.val[1], vbslq_u8(c15, v, u));
@@ -266,6 +509,7 @@ size_t crzy64_encode(uint8_t *CRZY64_RESTRICT d,
 			vst4q_u8(d, q1);
 			s += 48; n -= 48; d += 64;
 		}
+		CRZY64_STATS_MARK(0, CRZY64_PATH_UNROLL);
 #endif
 
 #if CRZY64_UNROLL > 1
@@ -273,7 +517,7 @@ size_t crzy64_encode(uint8_t *CRZY64_RESTRICT d,
 			uint8x16_t a1;
 			CRZY64_ENC_NEON_LD(a); s += 12;
 			CRZY64_ENC_NEON_LD(a1); s += 12;
-			CRZY64_PREFETCH(s + 1024 < end ? s + 1024 : end);
+			CRZY64_PREFETCH_AHEAD(s, end);
 			CRZY64_ENC_NEON();
 			vst1q_u8(d, a); d += 16;
 			a = a1;
@@ -295,6 +539,7 @@ size_t crzy64_encode(uint8_t *CRZY64_RESTRICT d,
 			s += 12; n -= 12; d += 16;
 		} while (n >= 12);
 #endif
+		CRZY64_STATS_MARK(0, CRZY64_PATH_VEC);
 	}
 #elif CRZY64_VEC && defined(__AVX2__)
 	if (n >= 24) {
@@ -307,27 +552,36 @@ size_t crzy64_encode(uint8_t *CRZY64_RESTRICT d,
 				0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
 		__m256i mask = _mm256_setr_epi32(0, -1, -1, -1, -1, -1, -1, 0);
 		const uint8_t *end = s + n - 24; (void)end;
+
+#define CRZY64_ENC_AVX2_LD(a) ( \
+	a = _mm256_maskload_epi32((const int32_t*)s - 1, mask), \
+	_mm256_shuffle_epi8(a, idx))
+
+#define CRZY64_ENC_AVX2(a) do { \
+	/* unpack */ \
+	c = _mm256_andnot_si256(ml, a);	/* fourth bytes are clear */ \
+	b = _mm256_xor_si256(c, _mm256_slli_epi32(c, 6)); \
+	b = _mm256_xor_si256(b, _mm256_slli_epi32(c, 12)); \
+	c = _mm256_and_si256(a, ml); \
+	a = _mm256_xor_si256(c, _mm256_srli_epi32(c, 6)); \
+	a = _mm256_xor_si256(a, _mm256_srli_epi32(c, 12)); \
+	a = _mm256_xor_si256(a, _mm256_slli_epi32(b, 6)); \
+	/* core */ \
+	a = _mm256_and_si256(a, c63); \
+	b = _mm256_and_si256(_mm256_cmpgt_epi8(a, c11), c7); \
+	c = _mm256_and_si256(_mm256_cmpgt_epi8(a, c37), c6); \
+	a = _mm256_add_epi8(a, c46); \
+	a = _mm256_add_epi8(_mm256_add_epi8(a, b), c); \
+} while (0)
+
 		do {
-			a = _mm256_maskload_epi32((const int32_t*)s - 1, mask);
-			CRZY64_PREFETCH(s + 1024 < end ? s + 1024 : end);
-			a = _mm256_shuffle_epi8(a, idx);
-			/* unpack */
-			c = _mm256_andnot_si256(ml, a);	/* fourth bytes are clear */
-			b = _mm256_xor_si256(c, _mm256_slli_epi32(c, 6));
-			b = _mm256_xor_si256(b, _mm256_slli_epi32(c, 12));
-			c = _mm256_and_si256(a, ml);
-			a = _mm256_xor_si256(c, _mm256_srli_epi32(c, 6));
-			a = _mm256_xor_si256(a, _mm256_srli_epi32(c, 12));
-			a = _mm256_xor_si256(a, _mm256_slli_epi32(b, 6));
-			/* core */
-			a = _mm256_and_si256(a, c63);
-			b = _mm256_and_si256(_mm256_cmpgt_epi8(a, c11), c7);
-			c = _mm256_and_si256(_mm256_cmpgt_epi8(a, c37), c6);
-			a = _mm256_add_epi8(a, c46);
-			a = _mm256_add_epi8(_mm256_add_epi8(a, b), c);
+			a = CRZY64_ENC_AVX2_LD(a);
+			CRZY64_PREFETCH_AHEAD(s, end);
+			CRZY64_ENC_AVX2(a);
 			_mm256_storeu_si256((__m256i*)d, a);
 			s += 24; n -= 24; d += 32;
 		} while (n >= 24);
+		CRZY64_STATS_MARK(0, CRZY64_PATH_VEC);
 	}
 #elif CRZY64_VEC && defined(__SSE2__)
 	if (n >= 12) {
@@ -340,44 +594,58 @@ size_t crzy64_encode(uint8_t *CRZY64_RESTRICT d,
 		__m128i mh = _mm_set1_epi32(0xfcf0c0);
 #endif
 		__m128i ml = _mm_set1_epi32(0x030f3f);
-		do {
+
 #ifdef __SSSE3__
-			a = _mm_loadl_epi64((const __m128i*)s);
 #ifdef __SSE4_1__
-			a = _mm_insert_epi32(a, *(uint32_t*)(s + 8), 2);
+#define CRZY64_ENC_SSE2_LD(a) ( \
+	a = _mm_loadl_epi64((const __m128i*)s), \
+	a = _mm_insert_epi32(a, *(uint32_t*)(s + 8), 2), \
+	_mm_shuffle_epi8(a, idx))
 #else
-			b = _mm_cvtsi32_si128(*(uint32_t*)(s + 8));
-			a = _mm_unpacklo_epi64(a, b);
-#endif
-			a = _mm_shuffle_epi8(a, idx);
-			/* unpack */
-			c = _mm_andnot_si128(ml, a);	/* fourth bytes are clear */
-#else
-			b = _mm_cvtsi32_si128(*(const uint32_t*)s);
-			c = _mm_cvtsi32_si128(*(const uint32_t*)(s + 3));
-			a = _mm_unpacklo_epi32(b, c);
-			b = _mm_cvtsi32_si128(*(const uint32_t*)(s + 6));
-			c = _mm_cvtsi32_si128(*(const uint32_t*)(s + 8));
-			b = _mm_unpacklo_epi32(b, _mm_srli_epi32(c, 8));
-			a = _mm_unpacklo_epi64(a, b);
-			/* unpack */
-			c = _mm_and_si128(a, mh);
+#define CRZY64_ENC_SSE2_LD(a) ( \
+	a = _mm_loadl_epi64((const __m128i*)s), \
+	b = _mm_cvtsi32_si128(*(uint32_t*)(s + 8)), \
+	a = _mm_unpacklo_epi64(a, b), \
+	_mm_shuffle_epi8(a, idx))
+#endif
+/* fourth bytes are clear */
+#define CRZY64_ENC_SSE2_HI(a) _mm_andnot_si128(ml, a)
+#else
+#define CRZY64_ENC_SSE2_LD(a) ( \
+	b = _mm_cvtsi32_si128(*(const uint32_t*)s), \
+	c = _mm_cvtsi32_si128(*(const uint32_t*)(s + 3)), \
+	a = _mm_unpacklo_epi32(b, c), \
+	b = _mm_cvtsi32_si128(*(const uint32_t*)(s + 6)), \
+	c = _mm_cvtsi32_si128(*(const uint32_t*)(s + 8)), \
+	b = _mm_unpacklo_epi32(b, _mm_srli_epi32(c, 8)), \
+	_mm_unpacklo_epi64(a, b))
+#define CRZY64_ENC_SSE2_HI(a) _mm_and_si128(a, mh)
 #endif
-			b = _mm_xor_si128(c, _mm_slli_epi32(c, 6));
-			b = _mm_xor_si128(b, _mm_slli_epi32(c, 12));
-			c = _mm_and_si128(a, ml);
-			a = _mm_xor_si128(c, _mm_srli_epi32(c, 6));
-			a = _mm_xor_si128(a, _mm_srli_epi32(c, 12));
-			a = _mm_xor_si128(a, _mm_slli_epi32(b, 6));
-			/* core */
-			a = _mm_and_si128(a, c63);
-			b = _mm_and_si128(_mm_cmpgt_epi8(a, c11), c7);
-			c = _mm_and_si128(_mm_cmpgt_epi8(a, c37), c6);
-			a = _mm_add_epi8(a, c46);
-			a = _mm_add_epi8(_mm_add_epi8(a, b), c);
+
+#define CRZY64_ENC_SSE2(a) do { \
+	/* unpack */ \
+	c = CRZY64_ENC_SSE2_HI(a); \
+	b = _mm_xor_si128(c, _mm_slli_epi32(c, 6)); \
+	b = _mm_xor_si128(b, _mm_slli_epi32(c, 12)); \
+	c = _mm_and_si128(a, ml); \
+	a = _mm_xor_si128(c, _mm_srli_epi32(c, 6)); \
+	a = _mm_xor_si128(a, _mm_srli_epi32(c, 12)); \
+	a = _mm_xor_si128(a, _mm_slli_epi32(b, 6)); \
+	/* core */ \
+	a = _mm_and_si128(a, c63); \
+	b = _mm_and_si128(_mm_cmpgt_epi8(a, c11), c7); \
+	c = _mm_and_si128(_mm_cmpgt_epi8(a, c37), c6); \
+	a = _mm_add_epi8(a, c46); \
+	a = _mm_add_epi8(_mm_add_epi8(a, b), c); \
+} while (0)
+
+		do {
+			a = CRZY64_ENC_SSE2_LD(a);
+			CRZY64_ENC_SSE2(a);
 			_mm_storeu_si128((__m128i*)d, a);
 			s += 12; n -= 12; d += 16;
 		} while (n >= 12);
+		CRZY64_STATS_MARK(0, CRZY64_PATH_VEC);
 	}
 #endif
 
@@ -407,6 +675,7 @@ size_t crzy64_encode(uint8_t *CRZY64_RESTRICT d,
 #endif
 		s += 6; n -= 6; d += 8;
 	} while (n >= 6);
+	CRZY64_STATS_MARK(0, CRZY64_PATH_FAST64);
 
 	if (n >= 3) {
 #else
@@ -425,6 +694,7 @@ size_t crzy64_encode(uint8_t *CRZY64_RESTRICT d,
 #endif
 		s += 3; n -= 3; d += 4;
 	}
+	CRZY64_STATS_MARK(0, CRZY64_PATH_SCALAR);
 
 	if (n) {
 		a = s[0];
@@ -450,9 +720,155 @@ size_t crzy64_encode(uint8_t *CRZY64_RESTRICT d,
 #endif
 	}
 
+	CRZY64_STATS_REST(0, CRZY64_PATH_TAIL);
+	CRZY64_PROBE1(encode_return, d - d0);
 	return d - d0;
 }
 
+/* Compares the text with the encoding of the data, which
+ * is computed in registers and never stored to memory.
+ * Returns zero if they match. Stops at the first mismatch
+ * unless (ct) is set, then the running time depends only on
+ * the length. */
+static CRZY64_INLINE uint64_t crzy64_diff(const uint8_t *e,
+		const uint8_t *s, size_t n, int ct) {
+	uint64_t r = 0; uint32_t a, b, c;
+
+#if CRZY64_VEC && CRZY64_NEON
+	if (n >= 12) {
+		uint8x16_t c11 = vdupq_n_u8(11), c37 = vdupq_n_u8(37);
+		uint8x16_t c46 = vdupq_n_u8(46), c63 = vdupq_n_u8(63);
+		uint8x16_t c52 = vdupq_n_u8(52), a, b, c;
+		uint8x8_t idx0 = vcreate_u8(0xff050403ff020100);
+#ifdef __aarch64__
+		uint8x8_t idx1 = vcreate_u8(0xff0b0a09ff080706);
+		uint8x16_t idx = vcombine_u8(idx0, idx1);
+#else
+		uint8x8_t idx1 = vcreate_u8(0xff070605ff040302);
+#endif
+		uint32x4_t ml = vdupq_n_u32(0x030f3f), x, y, z;
+		uint64x2_t t;
+		do {
+			CRZY64_ENC_NEON_LD(a);
+			CRZY64_ENC_NEON();
+			t = vreinterpretq_u64_u8(veorq_u8(a, vld1q_u8(e)));
+			r |= vgetq_lane_u64(t, 0) | vgetq_lane_u64(t, 1);
+			if (!ct && r) return r;
+			s += 12; n -= 12; e += 16;
+		} while (n >= 12);
+	}
+#elif CRZY64_VEC && defined(__AVX2__)
+	if (n >= 24) {
+		__m256i c11 = _mm256_set1_epi8(11), c37 = _mm256_set1_epi8(37);
+		__m256i c46 = _mm256_set1_epi8(46), c63 = _mm256_set1_epi8(63);
+		__m256i c6 = _mm256_set1_epi8(6), c7 = _mm256_set1_epi8(7), a, b, c;
+		__m256i ml = _mm256_set1_epi32(0x030f3f);
+		__m256i idx = _mm256_setr_epi8(
+				4, 5, 6, -1, 7, 8, 9, -1, 10, 11, 12, -1, 13, 14, 15, -1,
+				0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+		__m256i mask = _mm256_setr_epi32(0, -1, -1, -1, -1, -1, -1, 0);
+		do {
+			a = CRZY64_ENC_AVX2_LD(a);
+			CRZY64_ENC_AVX2(a);
+			a = _mm256_cmpeq_epi8(a, _mm256_loadu_si256((const __m256i*)e));
+			r |= ~(uint32_t)_mm256_movemask_epi8(a);
+			if (!ct && r) return r;
+			s += 24; n -= 24; e += 32;
+		} while (n >= 24);
+	}
+#elif CRZY64_VEC && defined(__SSE2__)
+	if (n >= 12) {
+		__m128i c11 = _mm_set1_epi8(11), c37 = _mm_set1_epi8(37);
+		__m128i c46 = _mm_set1_epi8(46), c63 = _mm_set1_epi8(63);
+		__m128i c6 = _mm_set1_epi8(6), c7 = _mm_set1_epi8(7), a, b, c;
+#ifdef __SSSE3__
+		__m128i idx = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+#else
+		__m128i mh = _mm_set1_epi32(0xfcf0c0);
+#endif
+		__m128i ml = _mm_set1_epi32(0x030f3f);
+		do {
+			a = CRZY64_ENC_SSE2_LD(a);
+			CRZY64_ENC_SSE2(a);
+			a = _mm_cmpeq_epi8(a, _mm_loadu_si128((const __m128i*)e));
+			r |= _mm_movemask_epi8(a) ^ 0xffff;
+			if (!ct && r) return r;
+			s += 12; n -= 12; e += 16;
+		} while (n >= 12);
+	}
+#endif
+
+#if CRZY64_FAST64
+	if (n >= 6) do {
+		uint64_t a, b, c;
+#if CRZY64_UNALIGNED && !defined(CRZY64_E2K_LCC)
+		a = *(const uint32_t*)s | (uint64_t)*(const uint32_t*)(s + 2) << 24;
+#else
+		a = s[0] | s[1] << 8 | s[2] << 16;
+		a |= (uint64_t)(s[3] | s[4] << 8 | s[5] << 16) << 32;
+#endif
+		a = crzy64_unpack64(a);
+		CRZY64_ENC8();
+#if CRZY64_UNALIGNED
+		r |= a ^ *(const uint64_t*)e;
+#else
+		b = e[0] | e[1] << 8 | e[2] << 16 | (uint32_t)e[3] << 24;
+		b |= (uint64_t)(e[4] | e[5] << 8 | e[6] << 16 | (uint32_t)e[7] << 24) << 32;
+		r |= a ^ b;
+#endif
+		if (!ct && r) return r;
+		s += 6; n -= 6; e += 8;
+	} while (n >= 6);
+
+	if (n >= 3) {
+#else
+	while (n >= 3) {
+#endif
+		a = s[0] | s[1] << 8 | s[2] << 16;
+		a = crzy64_unpack(a);
+		CRZY64_ENC4();
+#if CRZY64_UNALIGNED
+		r |= a ^ *(const uint32_t*)e;
+#else
+		r |= a ^ (e[0] | e[1] << 8 | e[2] << 16 | (uint32_t)e[3] << 24);
+#endif
+		if (!ct && r) return r;
+		s += 3; n -= 3; e += 4;
+	}
+
+	if (n) {
+		a = s[0];
+#if CRZY64_BRANCHLESS
+		a |= s[n - 1] << ((n << 3) - 8);
+#else
+		if (n > 1) a |= s[1] << 8;
+#endif
+		a = crzy64_unpack(a);
+		CRZY64_ENC4();
+		b = e[0] | e[1] << 8 | e[n] << (n << 3);
+		r |= (a ^ b) & (~0u >> (24 - (n << 3)));
+	}
+	return r;
+}
+
+/* Checks that (e, en) is the encoding of (s, n). Only the exact
+ * output of crzy64_encode() matches, the unused bits of the
+ * last character must be zero. */
+CRZY64_ATTR
+int crzy64_equal(const uint8_t *e, size_t en,
+		const uint8_t *s, size_t n) {
+	if (en != (n * 4 + 2) / 3) return 0;
+	return !crzy64_diff(e, s, n, 0);
+}
+
+/* Same, but doesn't exit early, for comparing secrets. */
+CRZY64_ATTR
+int crzy64_equal_ct(const uint8_t *e, size_t en,
+		const uint8_t *s, size_t n) {
+	if (en != (n * 4 + 2) / 3) return 0;
+	return !crzy64_diff(e, s, n, 1);
+}
+
 #define CRZY64_DEC(a, b, R) (b = (a) & R(96), (a) - R(59) \
 	+ ((R(7) + ((b) >> 6)) & R(7)) \
 	+ ((R(5) + ((b) >> 5)) & R(6)))
@@ -470,6 +886,8 @@ CRZY64_ATTR
 size_t crzy64_decode(uint8_t *CRZY64_RESTRICT d,
 		const uint8_t *CRZY64_RESTRICT s, size_t n) {
 	uint8_t *d0 = d;
+	CRZY64_STATS_ENTER(1)
+	CRZY64_PROBE2(decode_entry, n, CRZY64_DEC_PATH(n));
 #if CRZY64_VEC && CRZY64_NEON
 	if (n >= 16) {
 		uint8x16_t a, b;
@@ -516,7 +934,7 @@ size_t crzy64_decode(uint8_t *CRZY64_RESTRICT d,
 		while (n >= 32) {
 			uint8x16_t a1;
 			a = vld1q_u8(s); s += 16;
-			CRZY64_PREFETCH(s + 1024 < end ? s + 1024 : end);
+			CRZY64_PREFETCH_AHEAD(s, end);
 			CRZY64_DEC_NEON();
 			a1 = vld1q_u8(s); s += 16;
 			CRZY64_DEC_NEON_ST(); d += 12;
@@ -525,6 +943,7 @@ size_t crzy64_decode(uint8_t *CRZY64_RESTRICT d,
 			CRZY64_DEC_NEON_ST(); d += 12;
 			n -= 32;
 		}
+		CRZY64_STATS_MARK(1, CRZY64_PATH_UNROLL);
 		if (n >= 16) {
 			a = vld1q_u8(s);
 			CRZY64_DEC_NEON();
@@ -534,12 +953,13 @@ size_t crzy64_decode(uint8_t *CRZY64_RESTRICT d,
 #else
 		do {
 			a = vld1q_u8(s);
-			CRZY64_PREFETCH(s + 1024 < end ? s + 1024 : end);
+			CRZY64_PREFETCH_AHEAD(s, end);
 			CRZY64_DEC_NEON();
 			CRZY64_DEC_NEON_ST();
 			s += 16; n -= 16; d += 12;
 		} while (n >= 16);
 #endif
+		CRZY64_STATS_MARK(1, CRZY64_PATH_VEC);
 #if 0 // worse
 		if (n) {
 			int32_t x;
@@ -571,6 +991,8 @@ size_t crzy64_decode(uint8_t *CRZY64_RESTRICT d,
 				*(uint16_t*)(d - 2) = x >> ((n << 3) - 16);
 			}
 		}
+		CRZY64_STATS_REST(1, CRZY64_PATH_TAIL);
+		CRZY64_PROBE1(decode_return, d - d0);
 		return d - d0;
 #endif
 	}
@@ -594,7 +1016,7 @@ size_t crzy64_decode(uint8_t *CRZY64_RESTRICT d,
 		while (n >= 32 * CRZY64_UNROLL) {
 			__m256i a1;
 			a = _mm256_loadu_si256((const __m256i*)s); s += 32;
-			CRZY64_PREFETCH(s + 1024 < end ? s + 1024 : end);
+			CRZY64_PREFETCH_AHEAD(s, end);
 			a = CRZY64_DEC_AVX2(a);
 #if CRZY64_UNROLL > 2
 			a1 = _mm256_loadu_si256((const __m256i*)s); s += 32;
@@ -612,6 +1034,7 @@ size_t crzy64_decode(uint8_t *CRZY64_RESTRICT d,
 			_mm256_maskstore_epi32((int32_t*)d - 1, mask, a); d += 24;
 			n -= 32 * CRZY64_UNROLL;
 		}
+		CRZY64_STATS_MARK(1, CRZY64_PATH_UNROLL);
 #if CRZY64_UNROLL == 2
 		if (n >= 32) {
 #else
@@ -625,12 +1048,13 @@ size_t crzy64_decode(uint8_t *CRZY64_RESTRICT d,
 #else
 		do {
 			a = _mm256_loadu_si256((const __m256i*)s);
-			CRZY64_PREFETCH(s + 1024 < end ? s + 1024 : end);
+			CRZY64_PREFETCH_AHEAD(s, end);
 			a = CRZY64_DEC_AVX2(a);
 			_mm256_maskstore_epi32((int32_t*)d - 1, mask, a);
 			s += 32; n -= 32; d += 24;
 		} while (n >= 32);
 #endif
+		CRZY64_STATS_MARK(1, CRZY64_PATH_VEC);
 		if (n) {
 			int32_t x; __m128i a1, b1, c1;
 			b1 = _mm_setr_epi8(
@@ -657,6 +1081,8 @@ size_t crzy64_decode(uint8_t *CRZY64_RESTRICT d,
 				*(uint16_t*)(d - 2) = x >> ((n << 3) - 16);
 			}
 		}
+		CRZY64_STATS_REST(1, CRZY64_PATH_TAIL);
+		CRZY64_PROBE1(decode_return, d - d0);
 		return d - d0;
 	}
 #elif CRZY64_VEC && defined(__SSE2__)
@@ -721,7 +1147,7 @@ size_t crzy64_decode(uint8_t *CRZY64_RESTRICT d,
 		while (n >= 32 + CRZY64_DEC_UNROLL_EXTRA) {
 			__m128i a1;
 			a = _mm_loadu_si128((const __m128i*)s); s += 16;
-			CRZY64_PREFETCH(s + 1024 < end ? s + 1024 : end);
+			CRZY64_PREFETCH_AHEAD(s, end);
 			a = CRZY64_DEC_SSE2(a);
 			a1 = _mm_loadu_si128((const __m128i*)s); s += 16;
 			CRZY64_DEC_SSE2_ST1(a); d += 12;
@@ -729,6 +1155,7 @@ size_t crzy64_decode(uint8_t *CRZY64_RESTRICT d,
 			CRZY64_DEC_SSE2_ST1(a); d += 12;
 			n -= 32;
 		}
+		CRZY64_STATS_MARK(1, CRZY64_PATH_UNROLL);
 #ifdef CRZY64_DEC_UNROLL_EXTRA
 		while (n >= 16) {
 #else
@@ -747,6 +1174,7 @@ size_t crzy64_decode(uint8_t *CRZY64_RESTRICT d,
 			s += 16; n -= 16; d += 12;
 		} while (n >= 16);
 #endif
+		CRZY64_STATS_MARK(1, CRZY64_PATH_VEC);
 #ifdef __SSSE3__
 		if (n) {
 			int32_t x;
@@ -772,6 +1200,8 @@ size_t crzy64_decode(uint8_t *CRZY64_RESTRICT d,
 				*(uint16_t*)(d - 2) = x >> ((n << 3) - 16);
 			}
 		}
+		CRZY64_STATS_REST(1, CRZY64_PATH_TAIL);
+		CRZY64_PROBE1(decode_return, d - d0);
 		return d - d0;
 #endif
 	}
@@ -790,6 +1220,7 @@ size_t crzy64_decode(uint8_t *CRZY64_RESTRICT d,
 				| ((uint32_t)b >> 16 & 0xff);
 		s += 16; n -= 16; d += 12;
 	} while (n >= 16);
+	CRZY64_STATS_MARK(1, CRZY64_PATH_UNROLL);
 #endif
 
 	if (n >= 8) do {
@@ -824,6 +1255,7 @@ size_t crzy64_decode(uint8_t *CRZY64_RESTRICT d,
 #endif
 		s += 8; n -= 8; d += 6;
 	} while (n >= 8);
+	CRZY64_STATS_MARK(1, CRZY64_PATH_FAST64);
 
 	if (n > 5) {
 		uint64_t a, b;
@@ -898,6 +1330,7 @@ size_t crzy64_decode(uint8_t *CRZY64_RESTRICT d,
 #endif
 		s += 4; n -= 4; d += 3;
 	} while (n >= 4);
+	CRZY64_STATS_MARK(1, CRZY64_PATH_SCALAR);
 
 	if (n > 1) {
 		uint32_t a, b;
@@ -923,7 +1356,475 @@ size_t crzy64_decode(uint8_t *CRZY64_RESTRICT d,
 	}
 #endif
 
+	CRZY64_STATS_REST(1, CRZY64_PATH_TAIL);
+	CRZY64_PROBE1(decode_return, d - d0);
+	return d - d0;
+}
+
+/* 4 characters always decode to 3 bytes */
+
+static CRZY64_INLINE size_t crzy64_encoded_size(size_t n) {
+	return n / 3 * 4 + (n % 3 ? n % 3 + 1 : 0);
+}
+
+static CRZY64_INLINE size_t crzy64_decoded_size(size_t n) {
+	return n / 4 * 3 + (n & 3 ? (n & 3) - 1 : 0);
+}
+
+/* Start of the group of characters that contains a raw offset. */
+static CRZY64_INLINE size_t crzy64_encoded_offset(size_t off) {
+	return off / 3 * 4;
+}
+
+/* Decodes raw bytes [off, off + len) of the text, using only the
+ * groups of characters that cover them. The range is clipped to
+ * the decoded size, returns the number of bytes written. */
+CRZY64_ATTR
+size_t crzy64_decode_range(uint8_t *CRZY64_RESTRICT d,
+		const uint8_t *CRZY64_RESTRICT s, size_t n,
+		size_t off, size_t len) {
+	size_t size = crzy64_decoded_size(n), k;
+	uint8_t tmp[3];
+
+	if (off >= size) return 0;
+	if (len > size - off) len = size - off;
+	k = crzy64_encoded_offset(off);
+	s += k; n -= k;
+
+	k = off % 3;
+	if (k) {
+		/* partial first group */
+		size_t m = 3 - k;
+		crzy64_decode(tmp, s, n < 4 ? n : 4);
+		if (m > len) m = len;
+		memcpy(d, tmp + k, m);
+		if (!(len -= m)) return m;
+		s += 4; d += m;
+		k = m;
+	}
+	return k + crzy64_decode(d, s, crzy64_encoded_size(len));
+}
+
+/*
+ * Encoding and decoding of a known number of raw bytes. With a
+ * constant (n) these compile to straight-line code: the vector
+ * blocks overlap instead of leaving a tail, the loops are fully
+ * unrolled and the tail has no branches.
+ */
+
+static CRZY64_ALWAYS_INLINE
+size_t crzy64_encode_fixed(uint8_t *CRZY64_RESTRICT d,
+		const uint8_t *CRZY64_RESTRICT s, size_t n) {
+#if CRZY64_VEC && defined(__SSSE3__)
+	size_t g = n / 3 * 3, i, j;
+	uint32_t a, b, c;
+#ifdef __AVX2__
+	if (g >= 24) {
+		__m256i c11 = _mm256_set1_epi8(11), c37 = _mm256_set1_epi8(37);
+		__m256i c46 = _mm256_set1_epi8(46), c63 = _mm256_set1_epi8(63);
+		__m256i c6 = _mm256_set1_epi8(6), c7 = _mm256_set1_epi8(7), a, b, c;
+		__m256i ml = _mm256_set1_epi32(0x030f3f);
+		__m256i idx = _mm256_setr_epi8(
+				0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+				4, 5, 6, -1, 7, 8, 9, -1, 10, 11, 12, -1, 13, 14, 15, -1);
+		CRZY64_UNROLL_ALL
+		for (i = 0; i < g; i += 24) {
+			j = i + 24 > g ? g - 24 : i;
+			a = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(s + j)));
+			a = _mm256_inserti128_si256(a,
+					_mm_loadu_si128((const __m128i*)(s + j + 8)), 1);
+			a = _mm256_shuffle_epi8(a, idx);
+			CRZY64_ENC_AVX2(a);
+			_mm256_storeu_si256((__m256i*)(d + j / 3 * 4), a);
+		}
+	} else
+#endif
+	if (g >= 12) {
+		__m128i c11 = _mm_set1_epi8(11), c37 = _mm_set1_epi8(37);
+		__m128i c46 = _mm_set1_epi8(46), c63 = _mm_set1_epi8(63);
+		__m128i c6 = _mm_set1_epi8(6), c7 = _mm_set1_epi8(7), a, b, c;
+		__m128i idx = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+		__m128i ml = _mm_set1_epi32(0x030f3f);
+		CRZY64_UNROLL_ALL
+		for (i = 0; i < g; i += 12) {
+			j = i + 12 > g ? g - 12 : i;
+			a = _mm_loadl_epi64((const __m128i*)(s + j));
+			b = _mm_cvtsi32_si128(*(const uint32_t*)(s + j + 8));
+			a = _mm_shuffle_epi8(_mm_unpacklo_epi64(a, b), idx);
+			/* unpack */
+			c = _mm_andnot_si128(ml, a);
+			b = _mm_xor_si128(c, _mm_slli_epi32(c, 6));
+			b = _mm_xor_si128(b, _mm_slli_epi32(c, 12));
+			c = _mm_and_si128(a, ml);
+			a = _mm_xor_si128(c, _mm_srli_epi32(c, 6));
+			a = _mm_xor_si128(a, _mm_srli_epi32(c, 12));
+			a = _mm_xor_si128(a, _mm_slli_epi32(b, 6));
+			/* core */
+			a = _mm_and_si128(a, c63);
+			b = _mm_and_si128(_mm_cmpgt_epi8(a, c11), c7);
+			c = _mm_and_si128(_mm_cmpgt_epi8(a, c37), c6);
+			a = _mm_add_epi8(a, c46);
+			a = _mm_add_epi8(_mm_add_epi8(a, b), c);
+			_mm_storeu_si128((__m128i*)(d + j / 3 * 4), a);
+		}
+	} else {
+		CRZY64_UNROLL_ALL
+		for (i = 0; i < g; i += 3) {
+			a = s[i] | s[i + 1] << 8 | s[i + 2] << 16;
+			a = crzy64_unpack(a);
+			CRZY64_ENC4();
+			*(uint32_t*)(d + i / 3 * 4) = a;
+		}
+	}
+
+	if (n - g) {
+		const uint8_t *p = s + g;
+		uint8_t *q = d + g / 3 * 4;
+		a = p[0];
+		if (n - g > 1) a |= p[1] << 8;
+		a = crzy64_unpack(a);
+		CRZY64_ENC4();
+		*(uint16_t*)q = a;
+		if (n - g > 1) q[2] = a >> 16;
+	}
+	return crzy64_encoded_size(n);
+#else
+	return crzy64_encode(d, s, n);
+#endif
+}
+
+/* (n) is the decoded size */
+static CRZY64_ALWAYS_INLINE
+size_t crzy64_decode_fixed(uint8_t *CRZY64_RESTRICT d,
+		const uint8_t *CRZY64_RESTRICT s, size_t n) {
+#if CRZY64_VEC && defined(__SSSE3__)
+	size_t m = crzy64_encoded_size(n), g = m & ~(size_t)3, i, j;
+	uint32_t a, b;
+#ifdef __AVX2__
+	if (g >= 32) {
+		__m256i c3 = _mm256_set1_epi8(3), a, b;
+		__m256i tab = _mm256_set1_epi32(0xc5cbd200);
+		__m256i idx = _mm256_setr_epi8(
+				-1, -1, -1, -1, 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14,
+				0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+		__m256i mask = _mm256_cmpgt_epi32(idx, c3);
+		CRZY64_UNROLL_ALL
+		for (i = 0; i < g; i += 32) {
+			j = i + 32 > g ? g - 32 : i;
+			a = _mm256_loadu_si256((const __m256i*)(s + j));
+			a = CRZY64_DEC_AVX2(a);
+			_mm256_maskstore_epi32((int32_t*)(d + j / 4 * 3) - 1, mask, a);
+		}
+	} else
+#endif
+	if (g >= 16) {
+		__m128i c3 = _mm_set1_epi8(3), a, b;
+		__m128i tab = _mm_set1_epi32(0xc5cbd200);
+		__m128i idx = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+		CRZY64_UNROLL_ALL
+		for (i = 0; i < g; i += 16) {
+			uint8_t *q;
+			j = i + 16 > g ? g - 16 : i;
+			q = d + j / 4 * 3;
+			a = _mm_loadu_si128((const __m128i*)(s + j));
+			b = _mm_and_si128(_mm_srli_epi16(a, 5), c3);
+			a = _mm_add_epi8(a, _mm_shuffle_epi8(tab, b));
+			a = _mm_xor_si128(a, _mm_srli_epi32(a, 6));
+			a = _mm_shuffle_epi8(a, idx);
+			_mm_storel_epi64((__m128i*)q, a);
+			*(uint32_t*)(q + 8) = _mm_cvtsi128_si32(_mm_bsrli_si128(a, 8));
+		}
+	} else {
+		CRZY64_UNROLL_ALL
+		for (i = 0; i < g; i += 4) {
+			a = *(const uint32_t*)(s + i);
+			a = CRZY64_DEC4(a, b);
+			a = CRZY64_PACK(a);
+			*(uint16_t*)(d + i / 4 * 3) = a;
+			d[i / 4 * 3 + 2] = a >> 16;
+		}
+	}
+
+	if (m - g) {
+		const uint8_t *p = s + g;
+		uint8_t *q = d + g / 4 * 3;
+		a = p[0] | p[1] << 8;
+		if (m - g > 2) a |= p[2] << 16;
+		a = CRZY64_DEC4(a, b);
+		a = CRZY64_PACK(a);
+		q[0] = a;
+		if (m - g > 2) q[1] = a >> 8;
+	}
+	return n;
+#else
+	return crzy64_decode(d, s, crzy64_encoded_size(n));
+#endif
+}
+
+/*
+ * Fixed width IDs: 64-bit values take 11 characters and 128-bit
+ * values (UUIDs) take 22 characters. The values are encoded in
+ * memory order, the output is the same as calling crzy64_encode()
+ * for each of them.
+ */
+
+#define CRZY64_ID64_SIZE 11
+#define CRZY64_ID128_SIZE 22
+
+CRZY64_ATTR
+size_t crzy64_encode_id64(uint8_t *CRZY64_RESTRICT d,
+		const uint64_t *CRZY64_RESTRICT s, size_t n) {
+	uint8_t *d0 = d;
+#if CRZY64_VEC && defined(__AVX2__)
+	if (n >= 3) {
+		__m256i c11 = _mm256_set1_epi8(11), c37 = _mm256_set1_epi8(37);
+		__m256i c46 = _mm256_set1_epi8(46), c63 = _mm256_set1_epi8(63);
+		__m256i c6 = _mm256_set1_epi8(6), c7 = _mm256_set1_epi8(7), a, b, c;
+		__m256i ml = _mm256_set1_epi32(0x030f3f);
+		/* two IDs, one in each lane */
+		__m256i idx = _mm256_setr_epi8(
+				0, 1, 2, -1, 3, 4, 5, -1, 6, 7, -1, -1, -1, -1, -1, -1,
+				8, 9, 10, -1, 11, 12, 13, -1, 14, 15, -1, -1, -1, -1, -1, -1);
+		/* the second store goes 5 bytes past the end */
+		do {
+			a = _mm256_broadcastsi128_si256(
+					_mm_loadu_si128((const __m128i*)s));
+			a = _mm256_shuffle_epi8(a, idx);
+			CRZY64_ENC_AVX2(a);
+			_mm_storeu_si128((__m128i*)d, _mm256_castsi256_si128(a));
+			_mm_storeu_si128((__m128i*)(d + 11), _mm256_extracti128_si256(a, 1));
+			s += 2; n -= 2; d += 22;
+		} while (n >= 3);
+	}
+#endif
+	for (; n; n--, s++)
+		d += crzy64_encode(d, (const uint8_t*)s, 8);
 	return d - d0;
 }
 
+CRZY64_ATTR
+size_t crzy64_decode_id64(uint64_t *CRZY64_RESTRICT d,
+		const uint8_t *CRZY64_RESTRICT s, size_t n) {
+	uint64_t *d0 = d;
+#if CRZY64_VEC && defined(__AVX2__)
+	if (n >= 3) {
+		__m256i c3 = _mm256_set1_epi8(3), a, b;
+		__m256i tab = _mm256_set1_epi32(0xc5cbd200);
+		__m256i idx = _mm256_setr_epi8(
+				0, 1, 2, 4, 5, 6, 8, 9, -1, -1, -1, -1, -1, -1, -1, -1,
+				0, 1, 2, 4, 5, 6, 8, 9, -1, -1, -1, -1, -1, -1, -1, -1);
+		/* the second load goes 5 bytes past the end */
+		do {
+			a = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)s));
+			a = _mm256_inserti128_si256(a,
+					_mm_loadu_si128((const __m128i*)(s + 11)), 1);
+			b = _mm256_and_si256(_mm256_srli_epi16(a, 5), c3);
+			a = _mm256_add_epi8(a, _mm256_shuffle_epi8(tab, b));
+			a = _mm256_xor_si256(a, _mm256_srli_epi32(a, 6));
+			a = _mm256_shuffle_epi8(a, idx);
+			a = _mm256_permute4x64_epi64(a, 8);
+			_mm_storeu_si128((__m128i*)d, _mm256_castsi256_si128(a));
+			s += 22; n -= 2; d += 2;
+		} while (n >= 3);
+	}
+#endif
+	for (; n; n--, d++, s += 11)
+		crzy64_decode((uint8_t*)d, s, 11);
+	return (uint8_t*)d - (uint8_t*)d0;
+}
+
+CRZY64_ATTR
+size_t crzy64_encode_id128(uint8_t *CRZY64_RESTRICT d,
+		const uint8_t *CRZY64_RESTRICT s, size_t n) {
+	uint8_t *d0 = d;
+#if CRZY64_VEC && defined(__AVX2__)
+	if (n) {
+		__m256i c11 = _mm256_set1_epi8(11), c37 = _mm256_set1_epi8(37);
+		__m256i c46 = _mm256_set1_epi8(46), c63 = _mm256_set1_epi8(63);
+		__m256i c6 = _mm256_set1_epi8(6), c7 = _mm256_set1_epi8(7), a, b, c;
+		__m256i ml = _mm256_set1_epi32(0x030f3f);
+		__m256i idx = _mm256_setr_epi8(
+				0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+				12, 13, 14, -1, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+		__m128i x;
+		do {
+			a = _mm256_broadcastsi128_si256(
+					_mm_loadu_si128((const __m128i*)s));
+			a = _mm256_shuffle_epi8(a, idx);
+			CRZY64_ENC_AVX2(a);
+			x = _mm256_extracti128_si256(a, 1);
+			_mm_storeu_si128((__m128i*)d, _mm256_castsi256_si128(a));
+			*(uint32_t*)(d + 16) = _mm_cvtsi128_si32(x);
+			*(uint16_t*)(d + 20) = _mm_extract_epi16(x, 2);
+			s += 16; d += 22;
+		} while (--n);
+	}
+#endif
+	for (; n; n--, s += 16)
+		d += crzy64_encode(d, s, 16);
+	return d - d0;
+}
+
+CRZY64_ATTR
+size_t crzy64_decode_id128(uint8_t *CRZY64_RESTRICT d,
+		const uint8_t *CRZY64_RESTRICT s, size_t n) {
+	uint8_t *d0 = d;
+#if CRZY64_VEC && defined(__AVX2__)
+	if (n) {
+		__m256i c3 = _mm256_set1_epi8(3), a, b;
+		__m256i tab = _mm256_set1_epi32(0xc5cbd200);
+		__m256i idx = _mm256_setr_epi8(
+				0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+				-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 1, 2, 4);
+		__m128i x;
+		do {
+			x = _mm_bsrli_si128(_mm_loadl_epi64((const __m128i*)(s + 14)), 2);
+			a = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)s));
+			a = _mm256_inserti128_si256(a, x, 1);
+			b = _mm256_and_si256(_mm256_srli_epi16(a, 5), c3);
+			a = _mm256_add_epi8(a, _mm256_shuffle_epi8(tab, b));
+			a = _mm256_xor_si256(a, _mm256_srli_epi32(a, 6));
+			a = _mm256_shuffle_epi8(a, idx);
+			x = _mm_or_si128(_mm256_castsi256_si128(a),
+					_mm256_extracti128_si256(a, 1));
+			_mm_storeu_si128((__m128i*)d, x);
+			s += 22; d += 16;
+		} while (--n);
+	}
+#endif
+	for (; n; n--, s += 22)
+		d += crzy64_decode(d, s, 22);
+	return d - d0;
+}
+
+static CRZY64_INLINE uint32_t crzy64_enc3(const uint8_t *s) {
+	uint32_t a = s[0] | s[1] << 8 | s[2] << 16, b, c;
+	a = crzy64_unpack(a);
+	CRZY64_ENC4();
+	return a;
+}
+
+/*
+ * Substring search without decoding. The match can start at any
+ * of the three positions within a 3-byte group, for each of them
+ * the groups fully covered by the needle are encoded to a fixed
+ * string (the core). The text is scanned for the first and last
+ * characters of the cores, then the core is compared in registers,
+ * and the partial groups at the edges are decoded and checked.
+ */
+
+#define CRZY64_FIND_SMALL 5
+
+static size_t crzy64_find_small(const uint8_t *e, size_t en,
+		const uint8_t *s, size_t n) {
+	uint8_t buf[CRZY64_FIND_SMALL + 192];
+	size_t i, k, m = 0, r = 0;
+	while (en) {
+		k = en < 256 ? en : 256;
+		m += crzy64_decode(buf + m, e, k);
+		e += k; en -= k;
+		for (i = 0; i + n <= m; i++)
+			if (!memcmp(buf + i, s, n)) return r + i;
+		/* keep the last (n - 1) bytes */
+		k = m - i;
+		memmove(buf, buf + i, k);
+		r += i; m = k;
+	}
+	return (size_t)-1;
+}
+
+CRZY64_ATTR
+size_t crzy64_find(const uint8_t *e, size_t en,
+		const uint8_t *s, size_t n) {
+	/* the phases in the order of raw offsets for the same core position */
+	static const uint8_t order[3] = { 1, 2, 0 };
+	size_t lead[3], core[3], tail[3], len[3], i, q, maxlen = 0;
+	uint8_t fc[3], lc[3], tmp[4];
+	unsigned p, j;
+
+	if (!n) return 0;
+	if (n > crzy64_decoded_size(en)) return (size_t)-1;
+	if (n < CRZY64_FIND_SMALL) return crzy64_find_small(e, en, s, n);
+
+	for (p = 0; p < 3; p++) {
+		lead[p] = p ? 3 - p : 0;
+		core[p] = (n - lead[p]) / 3 * 3;
+		tail[p] = n - lead[p] - core[p];
+		len[p] = core[p] / 3 * 4;
+		fc[p] = crzy64_enc3(s + lead[p]);
+		lc[p] = crzy64_enc3(s + lead[p] + core[p] - 3) >> 24;
+		if (maxlen < len[p]) maxlen = len[p];
+	}
+
+#define CRZY64_FIND_CHECK(q) do { \
+	for (j = 0; j < 3; j++) { \
+		p = order[j]; \
+		if (q < (lead[p] ? 4 : 0)) continue; \
+		if (q + len[p] + (tail[p] ? tail[p] + 1 : 0) > en) continue; \
+		if (e[q] != fc[p] || e[q + len[p] - 1] != lc[p]) continue; \
+		if (crzy64_diff(e + q, s + lead[p], core[p], 0)) continue; \
+		if (lead[p]) { \
+			crzy64_decode(tmp, e + q - 4, 4); \
+			if (memcmp(tmp + p, s, lead[p])) continue; \
+		} \
+		if (tail[p]) { \
+			crzy64_decode(tmp, e + q + len[p], tail[p] + 1); \
+			if (memcmp(tmp, s + n - tail[p], tail[p])) continue; \
+		} \
+		return (q >> 2) * 3 - lead[p]; \
+	} \
+} while (0)
+
+	i = 0;
+#if CRZY64_VEC && (defined(__AVX2__) || defined(__SSE2__))
+#ifdef __AVX2__
+#define CRZY64_FIND_W 32
+#define CRZY64_FIND_T __m256i
+#define CRZY64_FIND_LD(p) _mm256_loadu_si256((const __m256i*)(p))
+#define CRZY64_FIND_EQ(a, b) _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b))
+#define CRZY64_FIND_SET1 _mm256_set1_epi8
+#else
+#define CRZY64_FIND_W 16
+#define CRZY64_FIND_T __m128i
+#define CRZY64_FIND_LD(p) _mm_loadu_si128((const __m128i*)(p))
+#define CRZY64_FIND_EQ(a, b) _mm_movemask_epi8(_mm_cmpeq_epi8(a, b))
+#define CRZY64_FIND_SET1 _mm_set1_epi8
+#endif
+	if (en >= maxlen - 1 + CRZY64_FIND_W) {
+		CRZY64_FIND_T f0 = CRZY64_FIND_SET1(fc[0]), l0 = CRZY64_FIND_SET1(lc[0]);
+		CRZY64_FIND_T f1 = CRZY64_FIND_SET1(fc[1]), l1 = CRZY64_FIND_SET1(lc[1]);
+		CRZY64_FIND_T f2 = CRZY64_FIND_SET1(fc[2]), l2 = CRZY64_FIND_SET1(lc[2]);
+		const uint8_t *end = e + en - maxlen + 1 - CRZY64_FIND_W;
+		do {
+			const uint8_t *x = e + i;
+			uint32_t m;
+			CRZY64_PREFETCH_AHEAD(x, end);
+			m = CRZY64_FIND_EQ(CRZY64_FIND_LD(x), f0)
+					& CRZY64_FIND_EQ(CRZY64_FIND_LD(x + len[0] - 1), l0);
+			m |= CRZY64_FIND_EQ(CRZY64_FIND_LD(x), f1)
+					& CRZY64_FIND_EQ(CRZY64_FIND_LD(x + len[1] - 1), l1);
+			m |= CRZY64_FIND_EQ(CRZY64_FIND_LD(x), f2)
+					& CRZY64_FIND_EQ(CRZY64_FIND_LD(x + len[2] - 1), l2);
+			/* only the group starts */
+			m &= 0x11111111;
+			while (m) {
+				q = i + __builtin_ctz(m);
+				CRZY64_FIND_CHECK(q);
+				m &= m - 1;
+			}
+			i += CRZY64_FIND_W;
+		} while (e + i <= end);
+	}
+#undef CRZY64_FIND_W
+#undef CRZY64_FIND_T
+#undef CRZY64_FIND_LD
+#undef CRZY64_FIND_EQ
+#undef CRZY64_FIND_SET1
+#endif
+	for (q = i; q + 4 <= en; q += 4)
+		CRZY64_FIND_CHECK(q);
+#undef CRZY64_FIND_CHECK
+	return (size_t)-1;
+}
+
 #endif /* CRZY64_H */
@@ -0,0 +1,372 @@
+/*
+ * Copyright (c) 2021, Ilya Kurdyukov
+ * All rights reserved.
+ *
+ * crzy64: An easy to decode base64 modification. (C++ interface)
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * A thin C++20 layer over crzy64.h: exact sizes as constexpr
+ * functions, span/string_view arguments, and appenders that grow
+ * a caller-owned string without zero-filling it (C++23
+ * resize_and_overwrite, plain resize with older libraries).
+ */
+
+#ifndef CRZY64_HPP
+#define CRZY64_HPP
+
+/* the functions must be inline in a header used from many TUs */
+#ifndef CRZY64_ATTR
+#define CRZY64_ATTR inline
+#endif
+#include "crzy64.h"
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <ranges>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace crzy64 {
+
+constexpr std::size_t encoded_size(std::size_t n) noexcept {
+	return n / 3 * 4 + (n % 3 ? n % 3 + 1 : 0);
+}
+
+constexpr std::size_t decoded_size(std::size_t n) noexcept {
+	return n / 4 * 3 + (n & 3 ? (n & 3) - 1 : 0);
+}
+
+namespace detail {
+
+inline std::uint8_t *ptr(char *p) noexcept {
+	return reinterpret_cast<std::uint8_t*>(p);
+}
+inline std::uint8_t *ptr(std::byte *p) noexcept {
+	return reinterpret_cast<std::uint8_t*>(p);
+}
+inline const std::uint8_t *ptr(const char *p) noexcept {
+	return reinterpret_cast<const std::uint8_t*>(p);
+}
+inline const std::uint8_t *ptr(const std::byte *p) noexcept {
+	return reinterpret_cast<const std::uint8_t*>(p);
+}
+
+template <class String, class F>
+inline void grow(String &out, std::size_t n, F &&fn) {
+	std::size_t size = out.size();
+#ifdef __cpp_lib_string_resize_and_overwrite
+	out.resize_and_overwrite(size + n, [&](char *p, std::size_t) {
+		return size + fn(p + size);
+	});
+#else
+	out.resize(size + n);
+	out.resize(size + fn(out.data() + size));
+#endif
+}
+
+} // namespace detail
+
+/* The output must have room for encoded_size(src.size()). */
+inline std::size_t encode(std::span<const std::byte> src,
+		std::span<char> dst) noexcept {
+	assert(dst.size() >= encoded_size(src.size()));
+	return crzy64_encode(detail::ptr(dst.data()),
+			detail::ptr(src.data()), src.size());
+}
+
+/* The output must have room for decoded_size(src.size()). */
+inline std::size_t decode(std::string_view src,
+		std::span<std::byte> dst) noexcept {
+	assert(dst.size() >= decoded_size(src.size()));
+	return crzy64_decode(detail::ptr(dst.data()),
+			detail::ptr(src.data()), src.size());
+}
+
+inline bool equal(std::string_view enc,
+		std::span<const std::byte> raw) noexcept {
+	return crzy64_equal(detail::ptr(enc.data()), enc.size(),
+			detail::ptr(raw.data()), raw.size());
+}
+
+/* Straight-line code for a known size, see crzy64_encode_fixed(). */
+template <std::size_t N>
+inline std::size_t encode_fixed(std::span<const std::byte, N> src,
+		std::span<char, encoded_size(N)> dst) noexcept {
+	return crzy64_encode_fixed(detail::ptr(dst.data()),
+			detail::ptr(src.data()), N);
+}
+
+template <std::size_t N>
+inline std::size_t decode_fixed(std::span<const char, encoded_size(N)> src,
+		std::span<std::byte, N> dst) noexcept {
+	return crzy64_decode_fixed(detail::ptr(dst.data()),
+			detail::ptr(src.data()), N);
+}
+
+/* Appends the encoded data to the string, returns the number
+ * of characters added. Works with std::pmr::string as well. */
+template <class Traits, class Alloc>
+std::size_t encode_append(std::basic_string<char, Traits, Alloc> &out,
+		std::span<const std::byte> src) {
+	std::size_t n = encoded_size(src.size());
+	detail::grow(out, n, [&](char *p) {
+		return crzy64_encode(detail::ptr(p), detail::ptr(src.data()), src.size());
+	});
+	return n;
+}
+
+template <class Traits, class Alloc>
+std::size_t encode_append(std::basic_string<char, Traits, Alloc> &out,
+		std::string_view src) {
+	return encode_append(out, std::as_bytes(std::span(src)));
+}
+
+/* Appends the decoded bytes to the string. */
+template <class Traits, class Alloc>
+std::size_t decode_append(std::basic_string<char, Traits, Alloc> &out,
+		std::string_view src) {
+	std::size_t n = decoded_size(src.size());
+	detail::grow(out, n, [&](char *p) {
+		return crzy64_decode(detail::ptr(p), detail::ptr(src.data()), src.size());
+	});
+	return n;
+}
+
+/*
+ * Compile time versions, the scalar code of crzy64_encode() and
+ * crzy64_decode() with the same crzy64_unpack() and macros.
+ */
+
+namespace detail {
+
+template <class T>
+constexpr std::uint32_t u8(T x) noexcept {
+	return static_cast<unsigned char>(x);
+}
+
+template <class D, class S>
+constexpr std::size_t encode(D *d, const S *s, std::size_t n) noexcept {
+	D *d0 = d; std::uint32_t a = 0, b = 0, c = 0;
+	for (; n >= 3; s += 3, n -= 3, d += 4) {
+		a = u8(s[0]) | u8(s[1]) << 8 | u8(s[2]) << 16;
+		a = crzy64_unpack(a);
+		CRZY64_ENC4();
+		for (int i = 0; i < 4; i++) d[i] = static_cast<D>(a >> i * 8 & 0xff);
+	}
+	if (n) {
+		a = u8(s[0]);
+		if (n > 1) a |= u8(s[1]) << 8;
+		a = crzy64_unpack(a);
+		CRZY64_ENC4();
+		d[0] = static_cast<D>(a & 0xff);
+		d[1] = static_cast<D>(a >> 8 & 0xff);
+		if (n > 1) d[2] = static_cast<D>(a >> 16 & 0xff);
+		d += n + 1;
+	}
+	return d - d0;
+}
+
+template <class D, class S>
+constexpr std::size_t decode(D *d, const S *s, std::size_t n) noexcept {
+	D *d0 = d; std::uint32_t a = 0, b = 0;
+	for (; n >= 4; s += 4, n -= 4, d += 3) {
+		a = u8(s[0]) | u8(s[1]) << 8 | u8(s[2]) << 16 | u8(s[3]) << 24;
+		a = CRZY64_DEC4(a, b);
+		a = CRZY64_PACK(a);
+		for (int i = 0; i < 3; i++) d[i] = static_cast<D>(a >> i * 8 & 0xff);
+	}
+	if (n > 1) {
+		a = u8(s[0]) | u8(s[1]) << 8;
+		if (n > 2) a |= u8(s[2]) << 16;
+		a = CRZY64_DEC4(a, b);
+		a = CRZY64_PACK(a);
+		d[0] = static_cast<D>(a & 0xff);
+		if (n > 2) d[1] = static_cast<D>(a >> 8 & 0xff);
+		d += n - 1;
+	}
+	return d - d0;
+}
+
+} // namespace detail
+
+/* A string literal as a template argument, without the null. */
+template <std::size_t N>
+struct fixed_string {
+	char data[N - 1 ? N - 1 : 1] = {};
+	static constexpr std::size_t size = N - 1;
+	constexpr fixed_string(const char (&s)[N]) noexcept {
+		for (std::size_t i = 0; i < N - 1; i++) data[i] = s[i];
+	}
+};
+
+template <std::size_t N, class T>
+constexpr std::array<char, encoded_size(N)>
+encode_array(const std::array<T, N> &s) noexcept {
+	std::array<char, encoded_size(N)> d{};
+	detail::encode(d.data(), s.data(), N);
+	return d;
+}
+
+template <std::size_t N>
+constexpr std::array<std::uint8_t, decoded_size(N)>
+decode_array(const std::array<char, N> &s) noexcept {
+	std::array<std::uint8_t, decoded_size(N)> d{};
+	detail::decode(d.data(), s.data(), N);
+	return d;
+}
+
+/* crzy64::literal<"..."> is the decoded text,
+ * crzy64::encoded<"..."> is the encoded bytes of the string. */
+template <fixed_string S>
+inline constexpr auto literal = [] {
+	std::array<std::uint8_t, decoded_size(S.size)> d{};
+	detail::decode(d.data(), S.data, S.size);
+	return d;
+}();
+
+template <fixed_string S>
+inline constexpr auto encoded = [] {
+	std::array<char, encoded_size(S.size)> d{};
+	detail::encode(d.data(), S.data, S.size);
+	return d;
+}();
+
+namespace literals {
+
+/* "..."_crzy64 is the same as crzy64::literal<"..."> */
+template <fixed_string S>
+constexpr const auto &operator""_crzy64() noexcept {
+	return literal<S>;
+}
+
+} // namespace literals
+
+/*
+ * Lazy views: the input is processed in blocks through the SIMD
+ * code into a small internal buffer, the view is a range of chunks
+ * (spans into that buffer), so memory use doesn't depend on the
+ * input size. These are single pass input ranges, a chunk is valid
+ * until the iterator is incremented.
+ */
+
+template <class R>
+concept byte_range = std::ranges::contiguous_range<R> &&
+		std::ranges::sized_range<R> &&
+		sizeof(std::ranges::range_value_t<R>) == 1;
+
+template <std::ranges::view V, bool Decode>
+	requires byte_range<V>
+class codec_view : public std::ranges::view_interface<codec_view<V, Decode>> {
+	using out_t = std::conditional_t<Decode, std::byte, char>;
+	/* raw bytes per block, a multiple of 3 */
+	std::size_t block_ = 0;
+	V base_ = V();
+	std::unique_ptr<out_t[]> buf_;
+
+public:
+	static constexpr std::size_t default_block = 3 << 12;
+
+	codec_view() = default;
+	explicit codec_view(V base, std::size_t block = default_block) :
+			block_(block < 3 ? 3 : block / 3 * 3), base_(std::move(base)) {}
+
+	class iterator {
+		codec_view *parent_ = nullptr;
+		std::size_t pos_ = 0, len_ = 0;
+
+		void fill() {
+			auto *s = detail::ptr(reinterpret_cast<const char*>(
+					std::ranges::data(parent_->base_)));
+			std::size_t n = std::ranges::size(parent_->base_) - pos_;
+			std::size_t k = Decode ? parent_->block_ / 3 * 4 : parent_->block_;
+			auto *d = detail::ptr(parent_->buf_.get());
+			if (k > n) k = n;
+			len_ = Decode ? crzy64_decode(d, s + pos_, k) :
+					crzy64_encode(d, s + pos_, k);
+			pos_ += k;
+			if (!k) parent_ = nullptr;
+		}
+
+	public:
+		using value_type = std::span<const out_t>;
+		using difference_type = std::ptrdiff_t;
+		using iterator_concept = std::input_iterator_tag;
+
+		iterator() = default;
+		explicit iterator(codec_view *parent) : parent_(parent) { fill(); }
+
+		value_type operator*() const {
+			return value_type(parent_->buf_.get(), len_);
+		}
+		iterator &operator++() { fill(); return *this; }
+		void operator++(int) { fill(); }
+		friend bool operator==(const iterator &it, std::default_sentinel_t) {
+			return !it.parent_;
+		}
+	};
+
+	iterator begin() {
+		if (!buf_) buf_.reset(new out_t[Decode ? block_ : block_ / 3 * 4]);
+		return iterator(this);
+	}
+	std::default_sentinel_t end() const { return {}; }
+	V base() const & { return base_; }
+};
+
+namespace views {
+
+template <bool Decode>
+struct codec_fn {
+	template <std::ranges::viewable_range R>
+		requires byte_range<std::views::all_t<R>>
+	auto operator()(R &&r, std::size_t block =
+			codec_view<std::views::all_t<R>, Decode>::default_block) const {
+		return codec_view<std::views::all_t<R>, Decode>(
+				std::views::all(std::forward<R>(r)), block);
+	}
+
+	template <std::ranges::viewable_range R>
+		requires byte_range<std::views::all_t<R>>
+	friend auto operator|(R &&r, const codec_fn &fn) {
+		return fn(std::forward<R>(r));
+	}
+};
+
+/* range | crzy64::views::encode yields std::span<const char> chunks,
+ * range | crzy64::views::decode yields std::span<const std::byte>. */
+inline constexpr codec_fn<false> encode{};
+inline constexpr codec_fn<true> decode{};
+
+} // namespace views
+
+} // namespace crzy64
+
+#endif /* CRZY64_HPP */
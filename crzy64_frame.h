@@ -0,0 +1,278 @@
+/*
+ * Copyright (c) 2021, Ilya Kurdyukov
+ * All rights reserved.
+ *
+ * crzy64: An easy to decode base64 modification. (framed format)
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Framed format, the whole stream is still crzy64 text.
+ *
+ * Each frame starts with a 12-byte header encoded to 16 characters:
+ *   0: "cz", 2: type, 3: flags, 4: length (32-bit), 8: Adler-32
+ * A data frame is followed by its payload (length raw bytes) encoded
+ * independently of the others, so frames can be decoded in parallel.
+ * The optional index frame holds 64-bit character offsets of all the
+ * data frames, then the end frame stores the offset of the index in
+ * place of the length and checksum. All numbers are little endian.
+ * The writers return 0 for payloads that don't fit in the length.
+ */
+
+#ifndef CRZY64_FRAME_H
+#define CRZY64_FRAME_H
+
+#include "crzy64.h"
+
+#define CRZY64_FRAME_HEADER 16
+#define CRZY64_FRAME_BLOCK (3 << 16)
+
+#define CRZY64_FRAME_DATA 0
+#define CRZY64_FRAME_INDEX 1
+#define CRZY64_FRAME_END 2
+
+#define CRZY64_FRAME_CHECKSUM 1
+
+/* the largest payload of a frame */
+#define CRZY64_FRAME_MAX 0xffffffff
+
+typedef struct {
+	unsigned type, flags;
+	/* for the end frame, the offset of the index */
+	uint64_t len;
+	uint32_t sum;
+} crzy64_frame_t;
+
+static uint32_t crzy64_adler32(uint32_t sum, const uint8_t *s, size_t n) {
+	uint32_t a = sum & 0xffff, b = sum >> 16;
+	while (n) {
+		/* the largest n for which b doesn't overflow */
+		size_t k = n < 5552 ? n : 5552;
+		n -= k;
+		do a += *s++, b += a; while (--k);
+		a %= 65521; b %= 65521;
+	}
+	return a | b << 16;
+}
+
+static CRZY64_INLINE void crzy64_put32(uint8_t *d, uint32_t a) {
+	d[0] = a; d[1] = a >> 8; d[2] = a >> 16; d[3] = a >> 24;
+}
+
+static CRZY64_INLINE uint32_t crzy64_get32(const uint8_t *s) {
+	return s[0] | s[1] << 8 | s[2] << 16 | (uint32_t)s[3] << 24;
+}
+
+CRZY64_ATTR
+size_t crzy64_frame_write_header(uint8_t *d, const crzy64_frame_t *f) {
+	uint8_t h[12];
+	h[0] = 'c'; h[1] = 'z'; h[2] = f->type; h[3] = f->flags;
+	if (f->type == CRZY64_FRAME_END) {
+		crzy64_put32(h + 4, f->len);
+		crzy64_put32(h + 8, f->len >> 32);
+	} else {
+		crzy64_put32(h + 4, f->len);
+		crzy64_put32(h + 8, f->sum);
+	}
+	return crzy64_encode(d, h, 12);
+}
+
+/* Returns nonzero if the header is damaged. */
+CRZY64_ATTR
+int crzy64_frame_read_header(crzy64_frame_t *f, const uint8_t *s) {
+	uint8_t h[12];
+	crzy64_decode(h, s, CRZY64_FRAME_HEADER);
+	if (h[0] != 'c' || h[1] != 'z' || h[2] > CRZY64_FRAME_END) return 1;
+	if (h[3] & ~CRZY64_FRAME_CHECKSUM) return 1;
+	f->type = h[2];
+	f->flags = h[3];
+	f->len = crzy64_get32(h + 4);
+	f->sum = crzy64_get32(h + 8);
+	if (f->type == CRZY64_FRAME_END) {
+		f->len |= (uint64_t)f->sum << 32;
+		f->sum = 0;
+	}
+	return 0;
+}
+
+/* Size of a frame with (n) bytes of payload. */
+static CRZY64_INLINE size_t crzy64_frame_size(size_t n) {
+	return CRZY64_FRAME_HEADER + crzy64_encoded_size(n);
+}
+
+/* Writes a frame of the given type, the length is 32-bit. */
+CRZY64_ATTR
+size_t crzy64_frame_encode(uint8_t *d, const uint8_t *s, size_t n,
+		unsigned type, unsigned flags) {
+	crzy64_frame_t f;
+	if (n > CRZY64_FRAME_MAX) return 0;
+	f.type = type;
+	f.flags = flags;
+	f.len = n;
+	f.sum = flags & CRZY64_FRAME_CHECKSUM ? crzy64_adler32(1, s, n) : 0;
+	d += crzy64_frame_write_header(d, &f);
+	return CRZY64_FRAME_HEADER + crzy64_encode(d, s, n);
+}
+
+/* Decodes the payload of a frame which header is already read,
+ * (s) points after the header. Returns nonzero on a checksum error. */
+CRZY64_ATTR
+int crzy64_frame_decode(uint8_t *d, const uint8_t *s,
+		const crzy64_frame_t *f) {
+	size_t n = crzy64_decode(d, s, crzy64_encoded_size(f->len));
+	if (f->flags & CRZY64_FRAME_CHECKSUM)
+		return crzy64_adler32(1, d, n) != f->sum;
+	return 0;
+}
+
+/* Writer-only flag, don't append the index and the end frame. */
+#define CRZY64_FRAME_NOINDEX 0x100
+
+/* Size of a framed stream. */
+static CRZY64_INLINE size_t crzy64_frames_bound(size_t n, size_t block,
+		unsigned flags) {
+	size_t k = (n + block - 1) / block;
+	n = k * CRZY64_FRAME_HEADER + n / block * crzy64_encoded_size(block)
+			+ crzy64_encoded_size(n % block);
+	if (!(flags & CRZY64_FRAME_NOINDEX))
+		n += crzy64_frame_size(k * 8) + CRZY64_FRAME_HEADER;
+	return n;
+}
+
+/* Writes the index for (k) frames of the same (size), except the
+ * last one, starting at (pos), and the end frame. */
+CRZY64_ATTR
+size_t crzy64_frames_write_index(uint8_t *d, uint64_t pos,
+		uint64_t k, uint64_t size, unsigned flags) {
+	uint8_t tmp[8 * 63], *d0 = d;
+	uint64_t i, j, m, x;
+	crzy64_frame_t f;
+	int pass;
+
+	if (k > CRZY64_FRAME_MAX / 8) return 0;
+	f.type = CRZY64_FRAME_INDEX;
+	f.flags = flags & CRZY64_FRAME_CHECKSUM;
+	f.len = k * 8;
+	f.sum = 1;
+	/* generated twice: for the checksum, then to encode */
+	for (pass = !f.flags; pass < 2; pass++) {
+		if (pass) d += crzy64_frame_write_header(d, &f);
+		for (i = 0; i < k; i += m) {
+			m = k - i < 63 ? k - i : 63;
+			for (j = 0; j < m; j++) {
+				x = (i + j) * size;
+				crzy64_put32(tmp + j * 8, x);
+				crzy64_put32(tmp + j * 8 + 4, x >> 32);
+			}
+			/* 504 is a multiple of 3 */
+			if (pass) d += crzy64_encode(d, tmp, m * 8);
+			else f.sum = crzy64_adler32(f.sum, tmp, m * 8);
+		}
+	}
+	f.type = CRZY64_FRAME_END;
+	f.flags = 0;
+	f.len = pos;
+	d += crzy64_frame_write_header(d, &f);
+	return d - d0;
+}
+
+/* Writes the whole stream, data frames of (block) bytes. */
+CRZY64_ATTR
+size_t crzy64_frames_encode(uint8_t *d, const uint8_t *s, size_t n,
+		size_t block, unsigned flags) {
+	size_t k = 0, pos = 0, m;
+	if ((n < block ? n : block) > CRZY64_FRAME_MAX) return 0;
+	if (!(flags & CRZY64_FRAME_NOINDEX) &&
+			(n + block - 1) / block > CRZY64_FRAME_MAX / 8) return 0;
+	for (; n; n -= m, s += m, k++) {
+		m = n < block ? n : block;
+		pos += crzy64_frame_encode(d + pos, s, m, CRZY64_FRAME_DATA,
+				flags & CRZY64_FRAME_CHECKSUM);
+	}
+	if (!(flags & CRZY64_FRAME_NOINDEX))
+		pos += crzy64_frames_write_index(d + pos, pos, k,
+				crzy64_frame_size(block), flags);
+	return pos;
+}
+
+/* Reads the end frame and the index, returns the number of data
+ * frames or -1 if there's no valid index. Writes up to (max)
+ * frame offsets. */
+CRZY64_ATTR
+size_t crzy64_frames_read_index(const uint8_t *s, size_t n,
+		uint64_t *offs, size_t max) {
+	uint8_t tmp[8 * 63];
+	crzy64_frame_t f;
+	size_t i, j, m, k, pos;
+	uint32_t sum = 1;
+
+	if (n < CRZY64_FRAME_HEADER * 2) return (size_t)-1;
+	if (crzy64_frame_read_header(&f, s + n - CRZY64_FRAME_HEADER) ||
+			f.type != CRZY64_FRAME_END) return (size_t)-1;
+	pos = f.len;
+	if (pos > n - CRZY64_FRAME_HEADER * 2 ||
+			crzy64_frame_read_header(&f, s + pos) ||
+			f.type != CRZY64_FRAME_INDEX || f.len & 7 ||
+			pos + crzy64_frame_size(f.len) != n - CRZY64_FRAME_HEADER)
+		return (size_t)-1;
+	s += pos + CRZY64_FRAME_HEADER;
+	k = f.len >> 3;
+	for (i = 0; i < k; i += m, s += m / 3 * 32) {
+		m = k - i < 63 ? k - i : 63;
+		crzy64_decode(tmp, s, crzy64_encoded_size(m * 8));
+		sum = crzy64_adler32(sum, tmp, m * 8);
+		for (j = 0; j < m && i + j < max; j++)
+			offs[i + j] = crzy64_get32(tmp + j * 8) |
+					(uint64_t)crzy64_get32(tmp + j * 8 + 4) << 32;
+	}
+	if (f.flags & CRZY64_FRAME_CHECKSUM && sum != f.sum) return (size_t)-1;
+	return k;
+}
+
+/* Decodes the whole stream serially, returns the decoded size
+ * or -1 if the stream is damaged. */
+CRZY64_ATTR
+size_t crzy64_frames_decode(uint8_t *d, const uint8_t *s, size_t n) {
+	const uint8_t *end = s + n;
+	uint8_t *d0 = d;
+	crzy64_frame_t f;
+
+	while ((size_t)(end - s) >= CRZY64_FRAME_HEADER) {
+		if (crzy64_frame_read_header(&f, s)) return (size_t)-1;
+		s += CRZY64_FRAME_HEADER;
+		if (f.type == CRZY64_FRAME_END) break;
+		if (f.len > (size_t)(end - s)) return (size_t)-1;
+		n = crzy64_encoded_size(f.len);
+		if (n > (size_t)(end - s)) return (size_t)-1;
+		if (f.type == CRZY64_FRAME_DATA) {
+			if (crzy64_frame_decode(d, s, &f)) return (size_t)-1;
+			d += f.len;
+		}
+		s += n;
+	}
+	if (s != end) return (size_t)-1;
+	return d - d0;
+}
+
+#endif /* CRZY64_FRAME_H */
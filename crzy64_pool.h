@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2021, Ilya Kurdyukov
+ * All rights reserved.
+ *
+ * crzy64: An easy to decode base64 modification. (buffer pool)
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Output buffers for encode/decode from per-thread free lists of
+ * power of two size classes (64 bytes to 32MB), aligned to 64 bytes.
+ * A buffer can be released from any thread, it goes to the free list
+ * of the releasing thread. The lists are freed when a thread exits.
+ * In C each translation unit has its own pool, in C++17 and later it's
+ * shared by the program. POSIX only, link with -pthread.
+ */
+
+#ifndef CRZY64_POOL_H
+#define CRZY64_POOL_H
+
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "crzy64.h"
+
+#ifndef CRZY64_POOL_DEPTH
+/* maximum number of free buffers per class */
+#define CRZY64_POOL_DEPTH 8
+#endif
+#define CRZY64_POOL_CLASSES 20
+#define CRZY64_POOL_ALIGN 64
+
+typedef struct crzy64_pool_hdr {
+	struct crzy64_pool_hdr *next;
+	unsigned cls;
+} crzy64_pool_hdr_t;
+
+typedef struct {
+	crzy64_pool_hdr_t *head[CRZY64_POOL_CLASSES];
+	unsigned count[CRZY64_POOL_CLASSES];
+	int init;
+} crzy64_pool_t;
+
+/* Buffer owned by the caller, return with crzy64_buf_release(). */
+typedef struct {
+	uint8_t *data;
+	size_t size;
+} crzy64_buf_t;
+
+CRZY64_STATIC CRZY64_TLS crzy64_pool_t crzy64_pool;
+CRZY64_STATIC pthread_key_t crzy64_pool_key;
+CRZY64_STATIC pthread_once_t crzy64_pool_once = PTHREAD_ONCE_INIT;
+
+#define CRZY64_POOL_HDR(p) \
+	((crzy64_pool_hdr_t*)((uint8_t*)(p) - CRZY64_POOL_ALIGN))
+
+/* Frees the free lists of the calling thread. */
+CRZY64_ATTR
+void crzy64_pool_trim(void) {
+	crzy64_pool_t *t = &crzy64_pool;
+	crzy64_pool_hdr_t *h;
+	unsigned i;
+	for (i = 0; i < CRZY64_POOL_CLASSES; i++) {
+		while ((h = t->head[i])) {
+			t->head[i] = h->next;
+			free(h);
+		}
+		t->count[i] = 0;
+	}
+}
+
+CRZY64_ATTR
+void crzy64_pool_exit(void *arg) {
+	(void)arg;
+	crzy64_pool_trim();
+}
+
+CRZY64_ATTR
+void crzy64_pool_key_init(void) {
+	pthread_key_create(&crzy64_pool_key, crzy64_pool_exit);
+}
+
+/* Returns a buffer for at least (n) bytes, NULL if out of memory. */
+CRZY64_ATTR
+uint8_t *crzy64_pool_get(size_t n) {
+	crzy64_pool_t *t = &crzy64_pool;
+	crzy64_pool_hdr_t *h;
+	unsigned i = 0;
+	void *p;
+
+	while (i < CRZY64_POOL_CLASSES && (size_t)CRZY64_POOL_ALIGN << i < n) i++;
+	if (i < CRZY64_POOL_CLASSES && (h = t->head[i])) {
+		t->head[i] = h->next;
+		t->count[i]--;
+		return (uint8_t*)h + CRZY64_POOL_ALIGN;
+	}
+	if (i < CRZY64_POOL_CLASSES) n = (size_t)CRZY64_POOL_ALIGN << i;
+	if (n > (size_t)-1 - CRZY64_POOL_ALIGN ||
+			posix_memalign(&p, CRZY64_POOL_ALIGN, n + CRZY64_POOL_ALIGN))
+		return NULL;
+	h = (crzy64_pool_hdr_t*)p;
+	h->cls = i;
+	return (uint8_t*)p + CRZY64_POOL_ALIGN;
+}
+
+/* Returns a buffer to the pool of the calling thread. */
+CRZY64_ATTR
+void crzy64_pool_put(void *p) {
+	crzy64_pool_t *t = &crzy64_pool;
+	crzy64_pool_hdr_t *h;
+	unsigned i;
+
+	if (!p) return;
+	h = CRZY64_POOL_HDR(p);
+	i = h->cls;
+	if (i >= CRZY64_POOL_CLASSES || t->count[i] >= CRZY64_POOL_DEPTH) {
+		free(h);
+		return;
+	}
+	if (!t->init) {
+		/* register the destructor that frees the lists at thread exit */
+		pthread_once(&crzy64_pool_once, crzy64_pool_key_init);
+		pthread_setspecific(crzy64_pool_key, t);
+		t->init = 1;
+	}
+	h->next = t->head[i];
+	t->head[i] = h;
+	t->count[i]++;
+}
+
+/* Usable size of a buffer from crzy64_pool_get(). */
+static CRZY64_INLINE size_t crzy64_pool_capacity(const void *p) {
+	unsigned i = CRZY64_POOL_HDR(p)->cls;
+	return i < CRZY64_POOL_CLASSES ? (size_t)CRZY64_POOL_ALIGN << i : 0;
+}
+
+CRZY64_ATTR
+crzy64_buf_t crzy64_pool_encode(const void *s, size_t n) {
+	crzy64_buf_t b;
+	b.size = 0;
+	if ((b.data = crzy64_pool_get(crzy64_encoded_size(n))))
+		b.size = crzy64_encode(b.data, (const uint8_t*)s, n);
+	return b;
+}
+
+CRZY64_ATTR
+crzy64_buf_t crzy64_pool_decode(const void *s, size_t n) {
+	crzy64_buf_t b;
+	b.size = 0;
+	if ((b.data = crzy64_pool_get(crzy64_decoded_size(n))))
+		b.size = crzy64_decode(b.data, (const uint8_t*)s, n);
+	return b;
+}
+
+static CRZY64_INLINE void crzy64_buf_release(crzy64_buf_t *b) {
+	crzy64_pool_put(b->data);
+	b->data = NULL;
+	b->size = 0;
+}
+
+#ifdef __cplusplus
+#include <memory>
+
+namespace crzy64 {
+
+struct pool_deleter {
+	void operator()(uint8_t *p) const noexcept { crzy64_pool_put(p); }
+};
+
+/* Owned pooled buffer, returned to the pool on destruction. */
+class pooled_buffer {
+	std::unique_ptr<uint8_t[], pool_deleter> ptr_;
+	size_t size_ = 0;
+public:
+	pooled_buffer() = default;
+	explicit pooled_buffer(crzy64_buf_t b) noexcept
+		: ptr_(b.data), size_(b.size) {}
+	uint8_t *data() noexcept { return ptr_.get(); }
+	const uint8_t *data() const noexcept { return ptr_.get(); }
+	size_t size() const noexcept { return size_; }
+	bool empty() const noexcept { return !size_; }
+	explicit operator bool() const noexcept { return ptr_ != nullptr; }
+	/* gives up the ownership, free with crzy64_pool_put() */
+	uint8_t *release() noexcept { size_ = 0; return ptr_.release(); }
+};
+
+inline pooled_buffer encode_pooled(const void *s, size_t n) {
+	return pooled_buffer(crzy64_pool_encode(s, n));
+}
+
+inline pooled_buffer decode_pooled(const void *s, size_t n) {
+	return pooled_buffer(crzy64_pool_decode(s, n));
+}
+
+}
+
+#endif
+
+#endif /* CRZY64_POOL_H */
@@ -0,0 +1,258 @@
+/*
+ * Copyright (c) 2021, Ilya Kurdyukov
+ * All rights reserved.
+ *
+ * crzy64: An easy to decode base64 modification. (lazy file reader)
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Maps an encoded file and decodes 4K raw pages (5462 characters)
+ * on demand into a bounded LRU cache. The reader can be shared
+ * between threads, the cache is guarded by a single mutex.
+ * POSIX only, link with -pthread.
+ */
+
+#ifndef CRZY64_READER_H
+#define CRZY64_READER_H
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "crzy64.h"
+
+#define CRZY64_PAGE 4096
+#define CRZY64_NONE ((unsigned)-1)
+
+typedef struct {
+	size_t page;
+	unsigned refs, prev, next, hnext;
+} crzy64_slot_t;
+
+typedef struct {
+	const uint8_t *map;
+	size_t map_size, size;
+	pthread_mutex_t lock;
+	crzy64_slot_t *slots;
+	unsigned nslots, *hash, hmask;
+	/* most and least recently used */
+	unsigned head, tail;
+	uint8_t *mem;
+} crzy64_reader_t;
+
+#define CRZY64_HASH(r, page) \
+	((unsigned)((page) * 0x9e3779b1u) & (r)->hmask)
+
+CRZY64_ATTR
+crzy64_reader_t *crzy64_reader_open(const char *fn, size_t cache_pages) {
+	crzy64_reader_t *r; struct stat st;
+	unsigned i, h = 1;
+	int fd;
+
+	if (cache_pages - 1 >= 1 << 20) return NULL;
+	if ((fd = open(fn, O_RDONLY)) < 0) return NULL;
+	if (fstat(fd, &st) || !(r = (crzy64_reader_t*)calloc(1, sizeof(*r)))) {
+		close(fd);
+		return NULL;
+	}
+	r->map_size = st.st_size;
+	r->size = crzy64_decoded_size(r->map_size);
+	if (r->map_size) {
+		void *p = mmap(NULL, r->map_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (p != MAP_FAILED) {
+			r->map = (const uint8_t*)p;
+			posix_madvise(p, r->map_size, POSIX_MADV_RANDOM);
+		}
+	}
+	close(fd);
+	if (r->map_size && !r->map) goto err;
+
+	while (h < cache_pages * 2) h <<= 1;
+	r->nslots = cache_pages;
+	r->hmask = h - 1;
+	r->slots = (crzy64_slot_t*)malloc(cache_pages * sizeof(*r->slots));
+	r->hash = (unsigned*)malloc(h * sizeof(*r->hash));
+	if (posix_memalign((void**)&r->mem, 64, cache_pages * CRZY64_PAGE))
+		r->mem = NULL;
+	if (!r->slots || !r->hash || !r->mem) goto err;
+	if (pthread_mutex_init(&r->lock, NULL)) goto err;
+
+	for (i = 0; i < h; i++) r->hash[i] = CRZY64_NONE;
+	for (i = 0; i < cache_pages; i++) {
+		crzy64_slot_t *x = r->slots + i;
+		x->page = (size_t)-1;
+		x->refs = 0;
+		x->prev = i - 1;
+		x->next = i + 1 < cache_pages ? i + 1 : CRZY64_NONE;
+		x->hnext = CRZY64_NONE;
+	}
+	r->head = 0;
+	r->tail = cache_pages - 1;
+	return r;
+
+err:
+	if (r->map) munmap((void*)r->map, r->map_size);
+	free(r->slots); free(r->hash); free(r->mem); free(r);
+	return NULL;
+}
+
+CRZY64_ATTR
+void crzy64_reader_close(crzy64_reader_t *r) {
+	if (!r) return;
+	if (r->map) munmap((void*)r->map, r->map_size);
+	pthread_mutex_destroy(&r->lock);
+	free(r->slots); free(r->hash); free(r->mem); free(r);
+}
+
+/* Decoded size of the file. */
+static CRZY64_INLINE size_t crzy64_reader_size(const crzy64_reader_t *r) {
+	return r->size;
+}
+
+/* Passes a madvise() hint for the text of a raw range. */
+CRZY64_ATTR
+int crzy64_reader_advise(crzy64_reader_t *r,
+		size_t off, size_t len, int advice) {
+	size_t a, b, pg = sysconf(_SC_PAGESIZE);
+	if (off >= r->size) return 0;
+	if (len > r->size - off) len = r->size - off;
+	a = crzy64_encoded_offset(off) & ~(pg - 1);
+	b = crzy64_encoded_size(off + len);
+	return posix_madvise((void*)(r->map + a), b - a, advice);
+}
+
+static void crzy64_lru_unlink(crzy64_reader_t *r, unsigned i) {
+	crzy64_slot_t *x = r->slots + i;
+	if (x->prev != CRZY64_NONE) r->slots[x->prev].next = x->next;
+	else r->head = x->next;
+	if (x->next != CRZY64_NONE) r->slots[x->next].prev = x->prev;
+	else r->tail = x->prev;
+}
+
+static void crzy64_lru_front(crzy64_reader_t *r, unsigned i) {
+	crzy64_slot_t *x = r->slots + i;
+	x->prev = CRZY64_NONE;
+	x->next = r->head;
+	if (r->head != CRZY64_NONE) r->slots[r->head].prev = i;
+	else r->tail = i;
+	r->head = i;
+}
+
+/* Returns the slot with the page, decodes it if necessary,
+ * called with the lock held. */
+static unsigned crzy64_reader_get(crzy64_reader_t *r, size_t page) {
+	unsigned i, *p;
+
+	for (i = r->hash[CRZY64_HASH(r, page)];
+			i != CRZY64_NONE; i = r->slots[i].hnext)
+		if (r->slots[i].page == page) {
+			if (r->head != i) {
+				crzy64_lru_unlink(r, i);
+				crzy64_lru_front(r, i);
+			}
+			return i;
+		}
+
+	/* evict the least recently used unpinned page */
+	for (i = r->tail; i != CRZY64_NONE; i = r->slots[i].prev)
+		if (!r->slots[i].refs) break;
+	if (i == CRZY64_NONE) return i;
+
+	if (r->slots[i].page != (size_t)-1) {
+		p = r->hash + CRZY64_HASH(r, r->slots[i].page);
+		while (*p != i) p = &r->slots[*p].hnext;
+		*p = r->slots[i].hnext;
+	}
+	p = r->hash + CRZY64_HASH(r, page);
+	r->slots[i].hnext = *p; *p = i;
+	r->slots[i].page = page;
+
+	crzy64_decode_range(r->mem + (size_t)i * CRZY64_PAGE,
+			r->map, r->map_size, page * CRZY64_PAGE, CRZY64_PAGE);
+	crzy64_lru_unlink(r, i);
+	crzy64_lru_front(r, i);
+	return i;
+}
+
+/* Copies raw bytes [off, off + len), clipped to the file size.
+ * If all the cache is pinned, decodes directly. */
+CRZY64_ATTR
+size_t crzy64_reader_read(crzy64_reader_t *r,
+		void *dst, size_t off, size_t len) {
+	uint8_t *d = (uint8_t*)dst;
+	size_t k, n;
+
+	if (off >= r->size) return 0;
+	if (len > r->size - off) len = r->size - off;
+
+	pthread_mutex_lock(&r->lock);
+	for (n = len; n; n -= k, off += k, d += k) {
+		size_t page = off / CRZY64_PAGE, o = off % CRZY64_PAGE;
+		unsigned i;
+		k = CRZY64_PAGE - o;
+		if (k > n) k = n;
+		if ((i = crzy64_reader_get(r, page)) == CRZY64_NONE)
+			crzy64_decode_range(d, r->map, r->map_size, off, k);
+		else
+			memcpy(d, r->mem + (size_t)i * CRZY64_PAGE + o, k);
+	}
+	pthread_mutex_unlock(&r->lock);
+	return len;
+}
+
+/* Returns a pointer to the decoded byte at the offset, which stays
+ * valid until crzy64_reader_unpin(). Sets (*len) to the number of
+ * bytes available till the end of the page. Returns NULL if the
+ * offset is out of range or all the cache is pinned. */
+CRZY64_ATTR
+const uint8_t *crzy64_reader_pin(crzy64_reader_t *r,
+		size_t off, size_t *len) {
+	size_t page = off / CRZY64_PAGE, o = off % CRZY64_PAGE;
+	unsigned i;
+
+	*len = 0;
+	if (off >= r->size) return NULL;
+	pthread_mutex_lock(&r->lock);
+	i = crzy64_reader_get(r, page);
+	if (i != CRZY64_NONE) r->slots[i].refs++;
+	pthread_mutex_unlock(&r->lock);
+	if (i == CRZY64_NONE) return NULL;
+
+	*len = r->size - off < CRZY64_PAGE - o ? r->size - off : CRZY64_PAGE - o;
+	return r->mem + (size_t)i * CRZY64_PAGE + o;
+}
+
+CRZY64_ATTR
+void crzy64_reader_unpin(crzy64_reader_t *r, const uint8_t *p) {
+	unsigned i = (p - r->mem) / CRZY64_PAGE;
+	pthread_mutex_lock(&r->lock);
+	r->slots[i].refs--;
+	pthread_mutex_unlock(&r->lock);
+}
+
+#endif /* CRZY64_READER_H */
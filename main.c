@@ -1,16 +1,659 @@
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 
 #include "crzy64.h"
+#include "crzy64_frame.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#if defined(__has_include) && defined(__NR_io_uring_setup)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define CRZY64_URING 1
+#endif
+#endif
+#endif
 
 #define N 4096
 
+static int encode_frames(void) {
+	size_t block = CRZY64_FRAME_BLOCK, n;
+	size_t fsize = crzy64_frame_size(block);
+	uint64_t pos = 0, k = 0;
+	uint8_t *buf = (uint8_t*)malloc(block + fsize), *out = buf + block;
+
+	if (!buf) return 1;
+	while ((n = fread(buf, 1, block, stdin))) {
+		n = crzy64_frame_encode(out, buf, n,
+				CRZY64_FRAME_DATA, CRZY64_FRAME_CHECKSUM);
+		fwrite(out, 1, n, stdout);
+		pos += n; k++;
+		if (n != fsize) break;
+	}
+	free(buf);
+
+	/* more frames than the index can hold */
+	if (k > CRZY64_FRAME_MAX / 8) return 1;
+	n = crzy64_frame_size(k * 8) + CRZY64_FRAME_HEADER;
+	if (!(buf = (uint8_t*)malloc(n))) return 1;
+	fwrite(buf, 1, crzy64_frames_write_index(buf, pos, k, fsize,
+			CRZY64_FRAME_CHECKSUM), stdout);
+	free(buf);
+	return 0;
+}
+
+/* Reads (n) bytes to the buffer, which grows only as the data
+ * arrives, so a damaged length can't take much memory. */
+static int read_grow(uint8_t **buf, size_t *size, size_t n) {
+	size_t k = 0, m;
+	void *p;
+	while (k < n) {
+		if (k == *size) {
+			m = *size < CRZY64_FRAME_BLOCK ? CRZY64_FRAME_BLOCK : *size * 2;
+			if (m > n) m = n;
+			if (!(p = realloc(*buf, m))) return -1;
+			*buf = (uint8_t*)p; *size = m;
+		}
+		m = (n < *size ? n : *size) - k;
+		if (fread(*buf + k, 1, m, stdin) != m) return 1;
+		k += m;
+	}
+	return 0;
+}
+
+static int decode_frames(void) {
+	uint8_t head[CRZY64_FRAME_HEADER], *buf = NULL, *out = NULL;
+	uint64_t pos = 0, ipos = 0, *offs = NULL;
+	size_t n, i, size = 0, osize = 0, nf = 0, maxf = 0;
+	const char *err = "damaged stream";
+	crzy64_frame_t f;
+	int ret = 1, index = 0, k;
+	void *p;
+
+	for (;;) {
+		n = fread(head, 1, CRZY64_FRAME_HEADER, stdin);
+		/* the index is optional */
+		if (!n && !index) { ret = 0; break; }
+		if (n != CRZY64_FRAME_HEADER || crzy64_frame_read_header(&f, head))
+			break;
+		if (f.type == CRZY64_FRAME_END) {
+			/* points to the index, the last frame */
+			if (index && f.len == ipos && getchar() == EOF) ret = 0;
+			break;
+		}
+		/* only the end frame after the index */
+		if (index) break;
+		n = crzy64_encoded_size(f.len);
+		if ((k = read_grow(&buf, &size, n))) {
+			if (k < 0) err = "out of memory";
+			break;
+		}
+		if (f.len > osize) {
+			if (!(p = realloc(out, f.len))) {
+				err = "out of memory";
+				break;
+			}
+			out = (uint8_t*)p; osize = f.len;
+		}
+		if (crzy64_frame_decode(out, buf, &f)) break;
+		if (f.type == CRZY64_FRAME_INDEX) {
+			/* the offsets of all the data frames */
+			if (f.len != nf * 8) break;
+			for (i = 0; i < nf; i++)
+				if (crzy64_get32(out + i * 8) != (uint32_t)offs[i] ||
+						crzy64_get32(out + i * 8 + 4) != offs[i] >> 32) break;
+			if (i < nf) break;
+			index = 1; ipos = pos;
+		} else {
+			if (nf == maxf) {
+				maxf = maxf ? maxf * 2 : 256;
+				if (!(p = realloc(offs, maxf * sizeof(*offs)))) {
+					err = "out of memory";
+					break;
+				}
+				offs = (uint64_t*)p;
+			}
+			offs[nf++] = pos;
+			fwrite(out, 1, f.len, stdout);
+		}
+		pos += CRZY64_FRAME_HEADER + n;
+	}
+	free(buf); free(out); free(offs);
+	if (ret) fprintf(stderr, "crzy64: %s\n", err);
+	return ret;
+}
+
+#ifdef __linux__
+static int write_all(int fd, const uint8_t *p, size_t n) {
+	ssize_t k;
+	for (; n; p += k, n -= k)
+		if ((k = write(fd, p, n)) <= 0) {
+			if (k < 0 && errno == EINTR) { k = 0; continue; }
+			/* O_DIRECT can't be used with this file or offset */
+			if (k < 0 && errno == EINVAL) {
+				int fl = fcntl(fd, F_GETFL);
+				if (fl >= 0 && fl & O_DIRECT &&
+						!fcntl(fd, F_SETFL, fl & ~O_DIRECT)) { k = 0; continue; }
+			}
+			return 1;
+		}
+	return 0;
+}
+
+/* turns O_DIRECT on or off for the output */
+static void set_direct(int on) {
+	int fl = fcntl(1, F_GETFL);
+	if (fl >= 0 && !(fl & O_DIRECT) == !!on)
+		fcntl(1, F_SETFL, fl ^ O_DIRECT);
+}
+
+/* Maps the input file and encodes or decodes it in large slices.
+ * Pipes get a plain write(): vmsplice() would give the reader our
+ * pages, which it can splice() on and read after we reuse them, and
+ * fresh pages for every slice are slower than the copy. Returns -1
+ * if the input can't be mapped. */
+static int map_io(int decode, int direct) {
+	struct stat st;
+	const uint8_t *map, *s;
+	uint8_t *buf;
+	size_t msize, size, n, k, half = 1 << 20, chunk;
+	off_t pos;
+	int ret = 0;
+
+	if (fstat(0, &st) || !S_ISREG(st.st_mode)) return -1;
+	if ((pos = lseek(0, 0, SEEK_CUR)) < 0 || pos >= st.st_size) return -1;
+	msize = st.st_size;
+	map = (const uint8_t*)mmap(NULL, msize, PROT_READ, MAP_PRIVATE, 0, 0);
+	if (map == MAP_FAILED) return -1;
+	madvise((void*)map, msize, MADV_SEQUENTIAL);
+	s = map + pos;
+	size = msize - pos;
+
+	if (!fstat(1, &st) && S_ISFIFO(st.st_mode)) {
+		/* fewer switches to the reader */
+		fcntl(1, F_SETPIPE_SZ, half);
+	} else if (direct) set_direct(1);
+	/* for O_DIRECT the output of a chunk must be a multiple of the page
+	 * size, when decoding 3 pages from 4 pages of input */
+	chunk = decode ? half / 12288 * 16384 : half / 4 * 3;
+
+	/* page aligned for O_DIRECT */
+	buf = (uint8_t*)mmap(NULL, half, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED) {
+		munmap((void*)map, msize);
+		return -1;
+	}
+
+	for (; size; size -= n, s += n) {
+		n = size < chunk ? size : chunk;
+		k = decode ? crzy64_decode(buf, s, n) : crzy64_encode(buf, s, n);
+		/* the tail is not aligned for O_DIRECT */
+		if (direct && k & 4095) set_direct(0);
+		if ((ret = write_all(1, buf, k))) break;
+	}
+	munmap(buf, half);
+	munmap((void*)map, msize);
+	return ret;
+}
+
+#ifdef CRZY64_URING
+#define URING_SLOTS 4
+
+typedef struct {
+	int fd;
+	unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *sq_ptr, *cq_ptr;
+	size_t sq_size, cq_size, sqes_size;
+	unsigned pending;
+} uring_t;
+
+static int uring_init(uring_t *u, unsigned entries) {
+	struct io_uring_params p;
+	uint8_t *sq, *cq;
+
+	memset(&p, 0, sizeof(p));
+	u->fd = syscall(__NR_io_uring_setup, entries, &p);
+	if (u->fd < 0) return 1;
+	u->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	u->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP && u->cq_size > u->sq_size)
+		u->sq_size = u->cq_size;
+	u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	u->sq_ptr = u->cq_ptr = u->sqes = NULL;
+
+	sq = (uint8_t*)mmap(NULL, u->sq_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+	if (sq == MAP_FAILED) goto err;
+	u->sq_ptr = sq;
+	if (p.features & IORING_FEAT_SINGLE_MMAP) cq = sq;
+	else {
+		cq = (uint8_t*)mmap(NULL, u->cq_size, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+		if (cq == MAP_FAILED) goto err;
+		u->cq_ptr = cq;
+	}
+	u->sqes = (struct io_uring_sqe*)mmap(NULL, u->sqes_size,
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			u->fd, IORING_OFF_SQES);
+	if (u->sqes == MAP_FAILED) { u->sqes = NULL; goto err; }
+
+	u->sq_head = (unsigned*)(sq + p.sq_off.head);
+	u->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+	u->sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+	u->sq_array = (unsigned*)(sq + p.sq_off.array);
+	u->cq_head = (unsigned*)(cq + p.cq_off.head);
+	u->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+	u->cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+	u->pending = 0;
+	return 0;
+
+err:
+	if (u->sq_ptr) munmap(u->sq_ptr, u->sq_size);
+	if (u->cq_ptr) munmap(u->cq_ptr, u->cq_size);
+	close(u->fd);
+	return 1;
+}
+
+static void uring_free(uring_t *u) {
+	munmap(u->sqes, u->sqes_size);
+	munmap(u->sq_ptr, u->sq_size);
+	if (u->cq_ptr) munmap(u->cq_ptr, u->cq_size);
+	close(u->fd);
+}
+
+static void uring_rw(uring_t *u, int op, int fd,
+		uint8_t *p, size_t n, unsigned buf, uint64_t data) {
+	unsigned tail = *u->sq_tail, i = tail & *u->sq_mask;
+	struct io_uring_sqe *e = u->sqes + i;
+	memset(e, 0, sizeof(*e));
+	e->opcode = op;
+	e->fd = fd;
+	/* use the current file position */
+	e->off = (uint64_t)-1;
+	e->addr = (uintptr_t)p;
+	e->len = n;
+	e->buf_index = buf;
+	e->user_data = data;
+	u->sq_array[i] = i;
+	__atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	u->pending++;
+}
+
+static int uring_enter(uring_t *u, unsigned wait) {
+	int k;
+	do k = syscall(__NR_io_uring_enter, u->fd, u->pending, wait,
+			wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+	while (k < 0 && errno == EINTR);
+	if (k < 0) return 1;
+	u->pending -= k;
+	return 0;
+}
+
+/* Reads the next chunk while the current one is encoded or decoded
+ * and the previous one is written. One read and one write are in
+ * flight at a time to keep the stream order, short transfers are
+ * resubmitted for the rest of the chunk. Returns -1 if io_uring
+ * is not available. */
+static int uring_io(int decode) {
+	size_t chunk = decode ? 1 << 18 : 3 << 16;
+	size_t osize = decode ? 3 << 16 : 1 << 18;
+	size_t fill[URING_SLOTS], len[URING_SLOTS], done = 0;
+	struct iovec iov[URING_SLOTS * 2];
+	unsigned i, rd = 0, cp = 0, wr = 0, head;
+	int reading = 0, writing = 0, eof = 0, ret = 1;
+	uint8_t *buf;
+	uring_t u;
+
+	if (uring_init(&u, 8)) return -1;
+	buf = (uint8_t*)mmap(NULL, (chunk + osize) * URING_SLOTS,
+			PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED) { uring_free(&u); return -1; }
+	for (i = 0; i < URING_SLOTS; i++) {
+		iov[i].iov_base = buf + chunk * i;
+		iov[i].iov_len = chunk;
+		iov[URING_SLOTS + i].iov_base = buf + chunk * URING_SLOTS + osize * i;
+		iov[URING_SLOTS + i].iov_len = osize;
+		fill[i] = 0;
+	}
+	if (syscall(__NR_io_uring_register, u.fd,
+			IORING_REGISTER_BUFFERS, iov, URING_SLOTS * 2)) {
+		munmap(buf, (chunk + osize) * URING_SLOTS);
+		uring_free(&u);
+		return -1;
+	}
+
+#define IN(i) ((uint8_t*)iov[i].iov_base)
+#define OUT(i) ((uint8_t*)iov[URING_SLOTS + (i)].iov_base)
+	for (;;) {
+		if (!reading && !eof && rd - wr < URING_SLOTS) {
+			i = rd % URING_SLOTS;
+			uring_rw(&u, IORING_OP_READ_FIXED, 0,
+					IN(i) + fill[i], chunk - fill[i], i, 0);
+			reading = 1;
+		}
+		if (!writing && wr != cp) {
+			i = wr % URING_SLOTS;
+			uring_rw(&u, IORING_OP_WRITE_FIXED, 1,
+					OUT(i) + done, len[i] - done, URING_SLOTS + i, 1);
+			writing = 1;
+		}
+		if (!reading && !writing && cp == rd) { ret = 0; break; }
+		/* wait only if there is nothing to compute */
+		if (uring_enter(&u, cp == rd)) break;
+
+		head = *u.cq_head;
+		for (; head != __atomic_load_n(u.cq_tail, __ATOMIC_ACQUIRE); head++) {
+			struct io_uring_cqe *e = u.cqes + (head & *u.cq_mask);
+			int res = e->res;
+			if (res == -EINTR || res == -EAGAIN) res = 0;
+			else if (res < 0) goto end;
+			if (!e->user_data) {
+				reading = 0;
+				i = rd % URING_SLOTS;
+				fill[i] += res;
+				if (!e->res) eof = 1;
+				if (fill[i] == chunk || (eof && fill[i])) rd++;
+			} else {
+				writing = 0;
+				done += res;
+				if (done == len[wr % URING_SLOTS]) {
+					fill[wr % URING_SLOTS] = 0;
+					done = 0; wr++;
+				}
+			}
+		}
+		__atomic_store_n(u.cq_head, head, __ATOMIC_RELEASE);
+
+		if (cp != rd) {
+			i = cp++ % URING_SLOTS;
+			len[i] = decode ? crzy64_decode(OUT(i), IN(i), fill[i]) :
+					crzy64_encode(OUT(i), IN(i), fill[i]);
+		}
+	}
+end:
+#undef IN
+#undef OUT
+	uring_free(&u);
+	munmap(buf, (chunk + osize) * URING_SLOTS);
+	return ret;
+}
+#endif
+#endif
+
+#ifndef _WIN32
+/* Ordered pipeline for -j: the reader fills a ring of chunks,
+ * workers encode or decode them in any order, and the writer
+ * outputs them in the order they were read. A regular input file
+ * is mapped, and the chunks point into the mapping. */
+typedef struct {
+	const uint8_t *in;
+	uint8_t *buf, *out;
+	size_t n, k;
+	int done;
+} chunk_t;
+
+/* chunks in the ring, 56MB */
+#define PIPELINE_MAX 32
+
+typedef struct {
+	chunk_t *ring;
+	const uint8_t *map;
+	size_t msize, mpos;
+	unsigned size, rd, cp, wr;
+	int decode, eof, stop, err;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} pipeline_t;
+
+static void *pipeline_reader(void *arg) {
+	pipeline_t *p = (pipeline_t*)arg;
+	size_t chunk = p->decode ? 1 << 20 : 3 << 18;
+	chunk_t *c;
+	int stop, err;
+	for (;;) {
+		pthread_mutex_lock(&p->lock);
+		while (p->rd - p->wr == p->size && !p->stop)
+			pthread_cond_wait(&p->cond, &p->lock);
+		stop = p->stop;
+		pthread_mutex_unlock(&p->lock);
+		if (stop) break;
+		c = p->ring + p->rd % p->size;
+		if (p->map) {
+			c->in = p->map + p->mpos;
+			c->n = p->msize - p->mpos < chunk ? p->msize - p->mpos : chunk;
+			p->mpos += c->n;
+			err = 0;
+		} else {
+			c->in = c->buf;
+			c->n = fread(c->buf, 1, chunk, stdin);
+			err = c->n != chunk && ferror(stdin);
+		}
+		c->done = 0;
+		pthread_mutex_lock(&p->lock);
+		/* the chunks read before the error are still written out */
+		if (err) p->err = p->stop = 1;
+		if (c->n && !p->stop) p->rd++;
+		if (c->n != chunk) p->eof = 1;
+		pthread_cond_broadcast(&p->cond);
+		pthread_mutex_unlock(&p->lock);
+		if (c->n != chunk) break;
+	}
+	return NULL;
+}
+
+/* on errors, the reader and the workers exit after the current chunk */
+static void pipeline_stop(pipeline_t *p) {
+	pthread_mutex_lock(&p->lock);
+	p->stop = p->eof = 1;
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->lock);
+}
+
+static void *pipeline_worker(void *arg) {
+	pipeline_t *p = (pipeline_t*)arg;
+	chunk_t *c;
+	for (;;) {
+		pthread_mutex_lock(&p->lock);
+		while (p->cp == p->rd && !p->eof) pthread_cond_wait(&p->cond, &p->lock);
+		if (p->cp == p->rd) {
+			pthread_mutex_unlock(&p->lock);
+			break;
+		}
+		c = p->ring + p->cp++ % p->size;
+		pthread_mutex_unlock(&p->lock);
+		c->k = p->decode ? crzy64_decode(c->out, c->in, c->n) :
+				crzy64_encode(c->out, c->in, c->n);
+		pthread_mutex_lock(&p->lock);
+		c->done = 1;
+		pthread_cond_broadcast(&p->cond);
+		pthread_mutex_unlock(&p->lock);
+	}
+	return NULL;
+}
+
+static int pipeline_io(int decode, unsigned nthreads, int direct) {
+	size_t isize = decode ? 1 << 20 : 3 << 18;
+	size_t osize = decode ? 3 << 18 : 1 << 20;
+	pthread_t reader, *workers;
+	pipeline_t p;
+	void *buf = NULL;
+	chunk_t *c;
+	struct stat st;
+	unsigned i, n = 0;
+	int ret = 0;
+
+	p.map = NULL;
+	/* two chunks for each worker, but no more than the input has */
+	p.size = nthreads < PIPELINE_MAX / 2 ? nthreads * 2 + 2 : PIPELINE_MAX;
+	if (!fstat(0, &st) && S_ISREG(st.st_mode)) {
+		off_t pos = lseek(0, 0, SEEK_CUR);
+		if (pos >= 0 && pos <= st.st_size &&
+				(st.st_size - pos) / isize + 1 < p.size)
+			p.size = (st.st_size - pos) / isize + 1;
+#ifdef __linux__
+		if (pos >= 0 && pos < st.st_size) {
+			p.map = (const uint8_t*)mmap(NULL, st.st_size,
+					PROT_READ, MAP_PRIVATE, 0, 0);
+			if (p.map == MAP_FAILED) p.map = NULL;
+			else {
+				madvise((void*)p.map, st.st_size, MADV_SEQUENTIAL);
+				p.msize = st.st_size;
+				p.mpos = pos;
+				/* the chunks don't need the input buffers */
+				isize = 0;
+			}
+		}
+#endif
+	}
+#ifdef __linux__
+	if (direct && !fstat(1, &st) && !S_ISFIFO(st.st_mode)) set_direct(1);
+	else direct = 0;
+#else
+	(void)direct;
+#endif
+	if (nthreads > p.size) nthreads = p.size;
+	p.rd = p.cp = p.wr = 0;
+	p.decode = decode;
+	p.eof = p.stop = p.err = 0;
+	p.ring = (chunk_t*)malloc(p.size * sizeof(*p.ring));
+	workers = (pthread_t*)malloc(nthreads * sizeof(*workers));
+	/* the output is page aligned for O_DIRECT */
+	if (posix_memalign(&buf, 4096, (isize + osize) * p.size)) buf = NULL;
+	if (!p.ring || !workers || !buf) {
+		free(p.ring); free(workers); free(buf);
+#ifdef __linux__
+		if (p.map) munmap((void*)p.map, p.msize);
+#endif
+		return 1;
+	}
+	for (i = 0; i < p.size; i++) {
+		p.ring[i].buf = (uint8_t*)buf + (isize + osize) * i;
+		p.ring[i].out = p.ring[i].buf + isize;
+	}
+	pthread_mutex_init(&p.lock, NULL);
+	pthread_cond_init(&p.cond, NULL);
+
+	if (pthread_create(&reader, NULL, pipeline_reader, &p)) nthreads = 0, ret = 1;
+	for (; n < nthreads; n++)
+		if (pthread_create(workers + n, NULL, pipeline_worker, &p)) break;
+	if (!n && !ret) {
+		pipeline_stop(&p);
+		ret = 1;
+	}
+
+	while (n) {
+		pthread_mutex_lock(&p.lock);
+		for (;;) {
+			c = p.ring + p.wr % p.size;
+			if (p.wr != p.cp && c->done) break;
+			if (p.eof && p.wr == p.rd) { c = NULL; break; }
+			pthread_cond_wait(&p.cond, &p.lock);
+		}
+		pthread_mutex_unlock(&p.lock);
+		if (!c) break;
+#ifdef __linux__
+		if (direct) {
+			/* the tail is not aligned for O_DIRECT */
+			if (c->k & 4095) set_direct(0);
+			if (write_all(1, c->out, c->k)) {
+				pipeline_stop(&p);
+				ret = 1;
+				break;
+			}
+		} else
+#endif
+		if (fwrite(c->out, 1, c->k, stdout) != c->k) {
+			pipeline_stop(&p);
+			ret = 1;
+			break;
+		}
+		pthread_mutex_lock(&p.lock);
+		p.wr++;
+		pthread_cond_broadcast(&p.cond);
+		pthread_mutex_unlock(&p.lock);
+	}
+
+	if (nthreads) pthread_join(reader, NULL);
+	while (n) pthread_join(workers[--n], NULL);
+	pthread_cond_destroy(&p.cond);
+	pthread_mutex_destroy(&p.lock);
+	free(p.ring); free(workers); free(buf);
+#ifdef __linux__
+	if (p.map) munmap((void*)p.map, p.msize);
+#endif
+	return ret | p.err;
+}
+#endif
+
 int main(int argc, char **argv) {
 	uint8_t buf[N * 4], out[N * 4];
 	size_t n;
+	int decode = 0, framed = 0, direct = 0, jobs = 0;
+
+	for (; argc > 1; argc--, argv++) {
+		if (!strcmp(argv[1], "-d")) decode = 1;
+		else if (!strcmp(argv[1], "-f")) framed = 1;
+		else if (!strcmp(argv[1], "-D")) direct = 1;
+#ifndef _WIN32
+		else if (argc > 2 && !strcmp(argv[1], "-j") &&
+				(jobs = atoi(argv[2])) > 0 && jobs <= 256) argc--, argv++;
+#endif
+		else break;
+	}
+	/* the framed format is written by one thread */
+	if (argc > 1 || (framed && jobs)) {
+		fprintf(stderr, "Usage: crzy64 [-d] [-f] [-D] [-j N]\n"
+			"  -d  decode\n"
+			"  -f  framed format with checksums and index\n"
+			"  -D  use O_DIRECT when writing to a file\n"
+			"  -j  number of worker threads, not with -f\n");
+		return 1;
+	}
+
+	if (framed) return decode ? decode_frames() : encode_frames();
+#ifndef _WIN32
+	if (jobs) {
+		int ret = pipeline_io(decode, jobs, direct);
+		if (ret) fprintf(stderr, "crzy64: I/O error\n");
+		return ret;
+	}
+#endif
+#ifdef __linux__
+	{
+		int ret = map_io(decode, direct);
+#ifdef CRZY64_URING
+		if (ret < 0) ret = uring_io(decode);
+#endif
+		if (ret >= 0) {
+			if (ret) fprintf(stderr, "crzy64: I/O error\n");
+			return ret;
+		}
+	}
+#else
+	(void)direct;
+#endif
 
-	if (argc > 1 && !strcmp(argv[1], "-d")) {
+	if (decode) {
 		do {
 			n = fread(buf, 1, N * 4, stdin);
 			if (!n) break;
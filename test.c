@@ -5,10 +5,23 @@
 #include <time.h>
 
 #include "crzy64.h"
+#include "crzy64_frame.h"
+#ifndef _WIN32
+#include "crzy64_reader.h"
+#include "crzy64_pool.h"
+#endif
 
 #define N 128
 #define GUARD_SIZE 8
 
+static size_t naive_find(const uint8_t *s, size_t n,
+		const uint8_t *p, size_t m) {
+	size_t i;
+	for (i = 0; i + m <= n; i++)
+		if (!memcmp(s + i, p, m)) return i;
+	return (size_t)-1;
+}
+
 int main() {
 	static const uint8_t set[] = {
 		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdef"
@@ -20,7 +33,7 @@ int main() {
 #endif
 	};
 	uint8_t src[N * 3];
-	size_t n; unsigned i, j;
+	size_t n; unsigned i, j, k;
 	uint8_t valid[256] = { 0 };
 	uint8_t buf0[N * 4 + GUARD_SIZE * 2], *buf = buf0 + GUARD_SIZE;
 	uint8_t out0[N * 3 + GUARD_SIZE * 2], *out = out0 + GUARD_SIZE;
@@ -56,6 +69,17 @@ int main() {
 		CHECK_GUARD(buf + j, 0);
 		for (j = 0; j < n; j++)
 			if (!valid[buf[j]]) ERR("invalid character");
+		if (!crzy64_equal(buf, n, src, i) ||
+				!crzy64_equal_ct(buf, n, src, i))
+			ERR("encoded text doesn't compare equal");
+		if (crzy64_equal(buf, n - 1, src, i))
+			ERR("different lengths compare equal");
+		j = rand() % n;
+		buf[j] ^= 1;
+		if (crzy64_equal(buf, n, src, i) ||
+				crzy64_equal_ct(buf, n, src, i))
+			ERR("mismatch not detected");
+		buf[j] ^= 1;
 		SET_GUARD(out + i, 0);
 		n = crzy64_decode(out, buf, n);
 		if (n != i) ERR("invalid decoded size");
@@ -64,5 +88,217 @@ int main() {
 		if (memcmp(src, out, i))
 			ERR("doesn't match the source");
 	}
+
+	/* constant sizes around the block boundaries */
+#define TEST_FIXED(x) \
+	i = x; \
+	if (crzy64_encode_fixed(buf, src, x) != (x * 4 + 2) / 3) \
+		ERR("invalid encoded size"); \
+	crzy64_encode(buf + N * 2, src, x); \
+	if (memcmp(buf, buf + N * 2, (x * 4 + 2) / 3)) \
+		ERR("fixed encoding mismatch"); \
+	if (crzy64_decode_fixed(out, buf, x) != x || memcmp(out, src, x)) \
+		ERR("fixed decoding mismatch");
+	TEST_FIXED(1) TEST_FIXED(2) TEST_FIXED(3) TEST_FIXED(5) TEST_FIXED(8)
+	TEST_FIXED(11) TEST_FIXED(12) TEST_FIXED(13) TEST_FIXED(16) TEST_FIXED(20)
+	TEST_FIXED(23) TEST_FIXED(24) TEST_FIXED(25) TEST_FIXED(32) TEST_FIXED(47)
+	TEST_FIXED(48) TEST_FIXED(64) TEST_FIXED(100)
+#undef TEST_FIXED
+
+	n = crzy64_encode(buf, src, N);
+	for (j = 0; j < 1000; j++) {
+		size_t off = rand() % (N + 4), len = rand() % 40, k;
+		i = off;
+		memset(out, 0x55, len + 1);
+		k = crzy64_decode_range(out, buf, n, off, len);
+		if (k != (off < N ? len < N - off ? len : N - off : 0))
+			ERR("invalid range size");
+		if (out[k] != 0x55) ERR("range buffer overrun");
+		if (memcmp(out, src + off, k)) ERR("range doesn't match the source");
+	}
+
+	/* the first N bytes of src are filled */
+	for (i = 0; i < 8; i++) {
+		uint64_t ids[8];
+		memcpy(ids, src, i * 8);
+		memset(buf, 0x55, i * 22 + 1);
+		if (crzy64_encode_id64(buf, ids, i) != i * 11)
+			ERR("invalid encoded size");
+		if (buf[i * 11] != 0x55) ERR("id64 buffer overrun");
+		for (j = 0; j < i; j++) {
+			uint8_t tmp[11];
+			crzy64_encode(tmp, src + j * 8, 8);
+			if (memcmp(tmp, buf + j * 11, 11)) ERR("id64 encoding mismatch");
+		}
+		memset(ids, 0, sizeof(ids));
+		if (crzy64_decode_id64(ids, buf, i) != i * 8)
+			ERR("invalid decoded size");
+		if (memcmp(ids, src, i * 8)) ERR("id64 doesn't match the source");
+
+		if (crzy64_encode_id128(buf, src, i) != i * 22)
+			ERR("invalid encoded size");
+		if (buf[i * 22] != 0x55) ERR("id128 buffer overrun");
+		for (j = 0; j < i; j++) {
+			uint8_t tmp[22];
+			crzy64_encode(tmp, src + j * 16, 16);
+			if (memcmp(tmp, buf + j * 22, 22)) ERR("id128 encoding mismatch");
+		}
+		memset(out, 0x55, i * 16 + 1);
+		if (crzy64_decode_id128(out, buf, i) != i * 16)
+			ERR("invalid decoded size");
+		if (out[i * 16] != 0x55) ERR("id128 buffer overrun");
+		if (memcmp(out, src, i * 16)) ERR("id128 doesn't match the source");
+	}
+
+	for (k = 0; k < 2; k++) {
+		/* low entropy to have many partial matches */
+		for (j = 0; j < N * 3; j++)
+			src[j] = k ? rand() : rand() & 1;
+		for (i = 1; i <= 40; i++)
+		for (j = 0; j < 50; j++) {
+			size_t len = N * 3 - rand() % 32, off = rand() % (len - i + 1);
+			uint8_t needle[40], *p = src + off;
+			if (j & 1) {
+				for (off = 0; off < i; off++) needle[off] = rand() & (k ? 255 : 1);
+				p = needle;
+			}
+			n = crzy64_encode(buf, src, len);
+			if (crzy64_find(buf, n, p, i) != naive_find(src, len, p, i))
+				ERR("substring search failed");
+		}
+	}
+
+	/* framed format, blocks of 1..11 bytes */
+	for (i = 0; i < 2; i++)
+	for (j = 1; j < 12; j++) {
+		static uint8_t enc[N * 3 * 32];
+		uint64_t offs[N * 3];
+		crzy64_frame_t f;
+		unsigned flags = i ? CRZY64_FRAME_CHECKSUM : CRZY64_FRAME_NOINDEX;
+		size_t m = crzy64_frames_bound(N * 3, j, flags);
+		n = crzy64_frames_encode(enc, src, N * 3, j, flags);
+		if (n != m) ERR("invalid framed size");
+		memset(out, 0, N * 3);
+		if (crzy64_frames_decode(out, enc, n) != N * 3 ||
+				memcmp(out, src, N * 3)) ERR("framed stream doesn't match");
+		m = crzy64_frames_read_index(enc, n, offs, N * 3);
+		if (m != (i ? (N * 3 + j - 1) / j : (size_t)-1))
+			ERR("invalid frame index");
+		for (k = 0; i && k < m; k++)
+			if (crzy64_frame_read_header(&f, enc + offs[k]) ||
+					f.type != CRZY64_FRAME_DATA || f.len != (k < m - 1 ? j : N * 3 - k * j))
+				ERR("invalid frame offset");
+		if (i) {
+			enc[CRZY64_FRAME_HEADER] ^= 1;
+			if (crzy64_frames_decode(out, enc, n) != (size_t)-1)
+				ERR("checksum error not detected");
+		}
+		if (crzy64_frames_decode(out, enc, n - 1) != (size_t)-1)
+			ERR("truncated stream not detected");
+	}
+	/* lengths above 32 bits are rejected before writing */
+	if (sizeof(size_t) > 4 && (
+			crzy64_frame_encode(out, src, (size_t)CRZY64_FRAME_MAX + 1,
+				CRZY64_FRAME_DATA, 0) ||
+			crzy64_frames_write_index(out, 0, CRZY64_FRAME_MAX / 8 + 1, 16, 0)))
+		ERR("too long frame not rejected");
+
+#if CRZY64_STATS
+	{
+		crzy64_stats_t st0, st1;
+		uint64_t enc = 0, dec = 0;
+		crzy64_stats_sum(&st0);
+		for (j = 0; j < 5; j++) {
+			enc -= st0.bytes[0][j];
+			dec -= st0.bytes[1][j];
+		}
+		i = 100;
+		n = crzy64_encode(buf, src, i);
+		crzy64_decode(out, buf, n);
+		crzy64_stats_sum(&st1);
+		for (j = 0; j < 5; j++) {
+			enc += st1.bytes[0][j];
+			dec += st1.bytes[1][j];
+		}
+		if (enc != i || dec != n) ERR("invalid stats bytes");
+		if (st1.hist[0][7] != st0.hist[0][7] + 1 ||
+				st1.hist[1][8] != st0.hist[1][8] + 1)
+			ERR("invalid stats histogram");
+	}
+#endif
+
+#ifndef _WIN32
+	{
+		char fn[] = "/tmp/crzy64_testXXXXXX";
+		size_t size = CRZY64_PAGE * 5 + 1000, len, k;
+		uint8_t *raw = (uint8_t*)malloc(size * 3), *enc = raw + size;
+		const uint8_t *p1, *p2;
+		crzy64_reader_t *r;
+		int fd = mkstemp(fn);
+
+		if (fd < 0 || !raw) ERR("can't create a temporary file");
+		for (j = 0; j < size; j++) raw[j] = rand();
+		n = crzy64_encode(enc, raw, size);
+		i = write(fd, enc, n) != (ssize_t)n;
+		close(fd);
+		r = i ? NULL : crzy64_reader_open(fn, 2);
+		unlink(fn);
+		if (!r) ERR("can't open the reader");
+		if (crzy64_reader_size(r) != size) ERR("invalid reader size");
+
+		for (i = 0; i < 1000; i++) {
+			size_t off = rand() % size;
+			len = rand() % (CRZY64_PAGE * 3);
+			k = crzy64_reader_read(r, out0, off, len < sizeof(out0) ? len : sizeof(out0));
+			if (memcmp(out0, raw + off, k)) ERR("reader doesn't match the source");
+			len = (rand() & 4095) + off;
+			p1 = crzy64_reader_pin(r, len, &k);
+			if (len < size ? !p1 || memcmp(p1, raw + len, k) : p1 != NULL)
+				ERR("pinned page doesn't match the source");
+			if (p1) crzy64_reader_unpin(r, p1);
+		}
+
+		/* all the cache is pinned */
+		p1 = crzy64_reader_pin(r, 0, &k);
+		p2 = crzy64_reader_pin(r, CRZY64_PAGE, &k);
+		if (!p1 || !p2 || crzy64_reader_pin(r, CRZY64_PAGE * 2, &k))
+			ERR("unexpected pin result");
+		k = crzy64_reader_read(r, out0, CRZY64_PAGE * 3 - 10, 20);
+		if (k != 20 || memcmp(out0, raw + CRZY64_PAGE * 3 - 10, k))
+			ERR("reader doesn't match the source");
+		crzy64_reader_unpin(r, p1);
+		crzy64_reader_unpin(r, p2);
+		crzy64_reader_close(r);
+		free(raw);
+	}
+
+	{
+		crzy64_buf_t b1, b2;
+		uint8_t *p1, *p2;
+		for (i = 0; i < 100; i++) {
+			n = rand() % sizeof(src);
+			for (j = 0; j < n; j++) src[j] = rand();
+			b1 = crzy64_pool_encode(src, n);
+			b2 = crzy64_pool_decode(b1.data, b1.size);
+			if (!b1.data || !b2.data) ERR("pool allocation failed");
+			if (((uintptr_t)b1.data | (uintptr_t)b2.data) & (CRZY64_POOL_ALIGN - 1))
+				ERR("pool buffer is misaligned");
+			if (b2.size != n || memcmp(b2.data, src, n)) ERR("pool decode failed");
+			crzy64_buf_release(&b1);
+			crzy64_buf_release(&b2);
+		}
+		p1 = crzy64_pool_get(1000);
+		if (crzy64_pool_capacity(p1) != 1024) ERR("unexpected pool capacity");
+		crzy64_pool_put(p1);
+		p2 = crzy64_pool_get(600);
+		if (p1 != p2) ERR("pool buffer is not reused");
+		crzy64_pool_put(p2);
+		/* larger than the largest class */
+		p1 = crzy64_pool_get((size_t)64 << CRZY64_POOL_CLASSES);
+		if (p1 && crzy64_pool_capacity(p1)) ERR("unexpected pool capacity");
+		crzy64_pool_put(p1);
+		crzy64_pool_trim();
+	}
+#endif
 	return 0;
 }
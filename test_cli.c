@@ -0,0 +1,226 @@
+/*
+ * Tests of the crzy64 binary, Linux only: "-D" keeps O_DIRECT on the
+ * output file for encoding and decoding when the output is aligned,
+ * also with "-j",
+ * the output to a pipe stays intact when the reader passes the
+ * pages on with splice(), "-d -f" rejects damaged streams, and
+ * "-j" fails when the input can't be read.
+ *
+ * crzy64_test_cli [BINARY]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "crzy64.h"
+#include "crzy64_frame.h"
+
+/* the output of both is a multiple of 12K (3 pages), which is
+ * longer than one chunk of the binary for each direction */
+#define RAW_SIZE (12288 * 200)
+
+static pid_t spawn(char **argv, int in, int out, int unused) {
+	pid_t pid = fork();
+	if (!pid) {
+		dup2(in, 0); dup2(out, 1);
+		if (unused >= 0) close(unused);
+		execv(argv[0], argv);
+		_exit(127);
+	}
+	return pid;
+}
+
+static int wait_pid(pid_t pid) {
+	int status;
+	if (pid < 0 || waitpid(pid, &status, 0) < 0) return 1;
+	return !WIFEXITED(status) || WEXITSTATUS(status);
+}
+
+static int run(char **argv, int in, int out) {
+	return wait_pid(spawn(argv, in, out, -1));
+}
+
+static int write_all(int fd, const uint8_t *p, size_t n) {
+	ssize_t k;
+	for (; n; p += k, n -= k)
+		if ((k = write(fd, p, n)) <= 0) return 1;
+	return 0;
+}
+
+/* Moves the input pipe to a pipe of its own with splice(), and
+ * reads it later, as splice-based tools do, so the pages of the
+ * writer are read after it has returned from vmsplice(). */
+static int forward(int in, int out) {
+	static uint8_t buf[1 << 16];
+	int p[2];
+	ssize_t k, r;
+	if (pipe(p)) return 1;
+	fcntl(p[1], F_SETPIPE_SZ, 1 << 20);
+	while ((k = splice(in, NULL, p[1], NULL, 1 << 20, 0)) > 0) {
+		usleep(20000);
+		for (; k > 0; k -= r)
+			if ((r = read(p[0], buf, sizeof(buf))) <= 0 ||
+					write_all(out, buf, r)) return 1;
+	}
+	return k < 0;
+}
+
+/* compares the file with (p) */
+static int check_file(const char *fn, const uint8_t *p, size_t n) {
+	FILE *f = fopen(fn, "rb");
+	uint8_t buf[4096];
+	size_t k;
+	int ret = 0;
+	if (!f) return 1;
+	while ((k = fread(buf, 1, sizeof(buf), f)))
+		if (k > n || memcmp(buf, p, k)) { ret = 1; break; }
+		else p += k, n -= k;
+	fclose(f);
+	return ret || n;
+}
+
+static int write_file(const char *fn, const uint8_t *p, size_t n) {
+	FILE *f = fopen(fn, "wb");
+	int ret = 1;
+	if (!f) return 1;
+	if (fwrite(p, 1, n, f) == n) ret = 0;
+	if (fclose(f)) ret = 1;
+	return ret;
+}
+
+int main(int argc, char **argv) {
+	static const char *in_fn = "crzy64_test_cli.in", *out_fn = "crzy64_test_cli.out";
+	char *args[6] = { (char*)"./crzy64", (char*)"-D", NULL, NULL, NULL, NULL };
+	size_t n = RAW_SIZE, n2 = crzy64_encoded_size(n), i;
+	uint8_t *raw, *enc;
+	int op, in, out, fl, ret = 0;
+
+	if (argc > 1) args[0] = argv[1];
+	if (!(raw = (uint8_t*)malloc(n + n2))) return 1;
+	enc = raw + n;
+	for (i = 0; i < n; i++) raw[i] = i * 0x9e3779b1 >> 24;
+	crzy64_encode(enc, raw, n);
+
+	for (op = 0; op < 4 && !ret; op++) {
+		static const char *names[4] = { "encode", "decode", "-j encode", "-j decode" };
+		const char *name = names[op];
+		size_t k = op & 1 ? n : n2;
+		args[1] = (char*)(op & 1 ? "-d" : "-D");
+		args[2] = (char*)(op & 1 ? "-D" : NULL);
+		if (op & 2) {
+			char **a = args + 2 + (op & 1);
+			a[0] = (char*)"-j"; a[1] = (char*)"2"; a[2] = NULL;
+		}
+		if (write_file(in_fn, op & 1 ? enc : raw, op & 1 ? n2 : n)) {
+			fprintf(stderr, "can't write %s\n", in_fn);
+			ret = 1;
+			break;
+		}
+		in = open(in_fn, O_RDONLY);
+		out = open(out_fn, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (in < 0 || out < 0) {
+			fprintf(stderr, "can't open the test files\n");
+			ret = 1;
+		} else if ((fl = fcntl(out, F_GETFL)) < 0 ||
+				fcntl(out, F_SETFL, fl | O_DIRECT) ||
+				!(fcntl(out, F_GETFL) & O_DIRECT)) {
+			printf("O_DIRECT isn't supported here, skipped\n");
+		} else {
+			/* the flag is on the open file shared with the child */
+			fcntl(out, F_SETFL, fl);
+			if (run(args, in, out)) {
+				fprintf(stderr, "%s failed\n", name);
+				ret = 1;
+			} else if (!(fcntl(out, F_GETFL) & O_DIRECT)) {
+				fprintf(stderr, "O_DIRECT was turned off for %s\n", name);
+				ret = 1;
+			} else if (check_file(out_fn, op & 1 ? raw : enc, k)) {
+				fprintf(stderr, "%s output mismatch\n", name);
+				ret = 1;
+			}
+		}
+		if (in >= 0) close(in);
+		if (out >= 0) close(out);
+	}
+	args[3] = NULL;
+
+	/* encode to a pipe, which is read through splice() */
+	if (!ret && !write_file(in_fn, raw, n)) {
+		int p[2] = { -1, -1 };
+		pid_t pid, fwd = -1;
+		args[1] = NULL;
+		in = open(in_fn, O_RDONLY);
+		out = open(out_fn, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (in < 0 || out < 0 || pipe(p)) ret = 1;
+		else {
+			pid = spawn(args, in, p[1], p[0]);
+			close(p[1]);
+			if (!(fwd = fork())) _exit(forward(p[0], out));
+			close(p[0]);
+			ret = wait_pid(pid) | wait_pid(fwd);
+			if (ret) fprintf(stderr, "encode to a splice reader failed\n");
+			else if ((ret = check_file(out_fn, enc, n2)))
+				fprintf(stderr, "encode to a splice reader: output mismatch\n");
+		}
+		if (in >= 0) close(in);
+		if (out >= 0) close(out);
+	}
+
+	/* framed streams: valid, with an extra byte, without the end
+	 * frame, and with a huge length in the first header */
+	if (!ret) {
+		size_t m = crzy64_frames_bound(n, 1000, CRZY64_FRAME_CHECKSUM);
+		uint8_t *fr = (uint8_t*)malloc(m + 1);
+		crzy64_frame_t f;
+		int t;
+		args[1] = (char*)"-d"; args[2] = (char*)"-f";
+		if (!fr) return 1;
+		m = crzy64_frames_encode(fr, raw, n, 1000, CRZY64_FRAME_CHECKSUM);
+		fr[m] = 'A';
+		for (t = 0; t < 4 && !ret; t++) {
+			if (t == 3) {
+				crzy64_frame_read_header(&f, fr);
+				f.len = CRZY64_FRAME_MAX;
+				crzy64_frame_write_header(fr, &f);
+			}
+			if (write_file(in_fn, fr, t == 1 ? m + 1 : t == 2 ?
+					m - CRZY64_FRAME_HEADER : m)) ret = 1;
+			in = open(in_fn, O_RDONLY);
+			out = open(out_fn, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			if (ret || in < 0 || out < 0) ret = 1;
+			else if (run(args, in, out) != (t > 0)) {
+				fprintf(stderr, "framed stream %d: %s\n", t,
+						t ? "damage not detected" : "decode failed");
+				ret = 1;
+			} else if (!t && check_file(out_fn, raw, n)) {
+				fprintf(stderr, "framed stream: output mismatch\n");
+				ret = 1;
+			}
+			if (in >= 0) close(in);
+			if (out >= 0) close(out);
+		}
+		free(fr);
+	}
+	/* reading a directory fails after the open */
+	if (!ret) {
+		args[1] = (char*)"-j"; args[2] = (char*)"2";
+		in = open(".", O_RDONLY);
+		out = open(out_fn, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (in < 0 || out < 0) ret = 1;
+		else if (!run(args, in, out)) {
+			fprintf(stderr, "-j: read error not detected\n");
+			ret = 1;
+		}
+		if (in >= 0) close(in);
+		if (out >= 0) close(out);
+	}
+	unlink(in_fn); unlink(out_fn);
+	free(raw);
+	return ret;
+}
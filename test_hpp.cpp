@@ -0,0 +1,166 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+#include "crzy64.hpp"
+#include "crzy64_pool.h"
+
+#define N 128
+
+using namespace crzy64::literals;
+
+/* test_hpp2.cpp */
+const void *test_hpp_pool(const void *s, std::size_t n);
+#if CRZY64_STATS
+void test_hpp_encode(const void *s, std::size_t n);
+#endif
+
+template <class A>
+constexpr bool same(const A &a, std::string_view s) {
+	if (a.size() != s.size()) return false;
+	for (std::size_t i = 0; i < s.size(); i++)
+		if ((unsigned char)a[i] != (unsigned char)s[i]) return false;
+	return true;
+}
+
+/* compile time round trip for all lengths up to 64 */
+constexpr bool roundtrip() {
+	std::uint8_t s[64] = {}, d[64] = {};
+	char e[86] = {};
+	for (unsigned i = 0; i < 64; i++) s[i] = i * 0x9d ^ 0x5a;
+	for (std::size_t n = 0; n <= 64; n++) {
+		std::size_t k = crzy64::detail::encode(e, s, n);
+		if (k != crzy64::encoded_size(n)) return false;
+		for (std::size_t i = 0; i < k; i++) {
+			unsigned char c = e[i];
+			if (!((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+					(c >= '0' && c <= '9') || c == '.' || c == '/')) return false;
+		}
+		if (crzy64::detail::decode(d, e, k) != n) return false;
+		for (std::size_t i = 0; i < n; i++)
+			if (d[i] != s[i]) return false;
+	}
+	return true;
+}
+
+static_assert(roundtrip());
+static_assert(same(crzy64::encoded<"">, ""));
+static_assert(same(crzy64::encoded<"Hello, world!">, "QJQQETQAA9TQ0QQSV."));
+static_assert(same(crzy64::literal<"QJQQETQAA9TQ0QQSV.">, "Hello, world!"));
+static_assert(same("Y70.Luln.U"_crzy64,
+		std::string_view("\x00\x01\x02\xff\xfe\xfd\x80", 7)));
+static_assert(same(crzy64::encode_array(
+		std::array<std::uint8_t, 4>{ 0xff, 0xff, 0xff, 0xff }), "nnnnzk"));
+static_assert(same(crzy64::decode_array(crzy64::encoded<"crzy64">), "crzy64"));
+
+#define ERR(msg) do { \
+	std::fprintf(stderr, "%s at length %d\n", msg, (int)i); return 1; \
+} while (0)
+
+int main() {
+	std::vector<std::byte> src(N), out(N);
+	std::uint8_t ref[N * 4 / 3 + 1];
+	std::size_t i, n;
+
+	static_assert(crzy64::encoded_size(0) == 0);
+	static_assert(crzy64::encoded_size(1) == 2);
+	static_assert(crzy64::encoded_size(2) == 3);
+	static_assert(crzy64::encoded_size(3) == 4);
+	static_assert(crzy64::decoded_size(4) == 3);
+	static_assert(crzy64::decoded_size(6) == 4);
+
+	for (i = 0; i < N; i++) src[i] = std::byte(std::rand());
+
+	for (i = 0; i <= N; i++) {
+		std::span<const std::byte> s(src.data(), i);
+		std::string buf(crzy64::encoded_size(i), '\0');
+		char pmr_mem[1024];
+		std::pmr::monotonic_buffer_resource mr(pmr_mem, sizeof(pmr_mem));
+		std::pmr::string pbuf("prefix", &mr);
+		std::string dec(N * 2, '\0');
+
+		if ((std::size_t)(i * 4 + 2) / 3 != crzy64::encoded_size(i))
+			ERR("invalid encoded size");
+		n = crzy64_encode(ref, (const std::uint8_t*)src.data(), i);
+		if (crzy64::encode(s, buf) != n || std::memcmp(buf.data(), ref, n))
+			ERR("doesn't match the C function");
+		if (!crzy64::equal(buf, s)) ERR("equal failed");
+		if (crzy64::detail::encode(dec.data(), src.data(), i) != n ||
+				std::memcmp(dec.data(), ref, n)) ERR("constexpr encoder mismatch");
+		if (crzy64::decode(buf, out) != i || std::memcmp(out.data(), src.data(), i))
+			ERR("doesn't match the source");
+
+		if (crzy64::encode_append(pbuf, s) != n || pbuf.size() != n + 6 ||
+				pbuf.compare(0, 6, "prefix") || std::memcmp(pbuf.data() + 6, ref, n))
+			ERR("pmr append failed");
+		dec = "xy";
+		if (crzy64::decode_append(dec, buf) != i || dec.size() != i + 2 ||
+				dec.compare(0, 2, "xy") || std::memcmp(dec.data() + 2, src.data(), i))
+			ERR("decode append failed");
+	}
+
+	{
+		std::array<char, 22> e;
+		std::array<std::byte, 16> d;
+		i = 16;
+		crzy64_encode(ref, (const std::uint8_t*)src.data(), 16);
+		if (crzy64::encode_fixed<16>(std::span<const std::byte, 16>(src.data(), 16), e) != 22 ||
+				std::memcmp(e.data(), ref, 22)) ERR("fixed encode mismatch");
+		if (crzy64::decode_fixed<16>(e, d) != 16 || std::memcmp(d.data(), src.data(), 16))
+			ERR("fixed decode mismatch");
+	}
+
+	/* lazy views, with small blocks to get many chunks */
+	for (i = 0; i <= N; i += 7) {
+		std::span<const std::byte> s(src.data(), i);
+		std::string enc, dec;
+		std::size_t chunks = 0;
+		n = crzy64_encode(ref, (const std::uint8_t*)src.data(), i);
+		for (auto chunk : crzy64::views::encode(s, 12)) {
+			enc.append(chunk.data(), chunk.size());
+			if (chunk.size() > 16) ERR("chunk is too big");
+			chunks++;
+		}
+		if (chunks != (i + 11) / 12) ERR("invalid number of chunks");
+		if (enc.size() != n || std::memcmp(enc.data(), ref, n))
+			ERR("encode view doesn't match");
+		for (auto chunk : enc | crzy64::views::decode)
+			dec.append((const char*)chunk.data(), chunk.size());
+		if (dec.size() != i || std::memcmp(dec.data(), src.data(), i))
+			ERR("decode view doesn't match");
+		static_assert(std::ranges::input_range<decltype(enc | crzy64::views::decode)>);
+	}
+
+	{
+		i = N;
+		auto e = crzy64::encode_pooled(src.data(), N);
+		auto d = crzy64::decode_pooled(e.data(), e.size());
+		const std::uint8_t *p = d.data();
+		if (!e || !d || d.size() != N || std::memcmp(d.data(), src.data(), N))
+			ERR("pooled buffer mismatch");
+		d = {};
+		if (crzy64::decode_pooled(e.data(), e.size()).data() != p)
+			ERR("pooled buffer is not reused");
+		/* released to the pool in the other unit */
+		p = (const std::uint8_t*)test_hpp_pool(src.data(), N);
+		if (crzy64::encode_pooled(src.data(), N).data() != p)
+			ERR("the pool isn't shared between translation units");
+	}
+
+#if CRZY64_STATS
+	{
+		crzy64_stats_t r1, r2;
+		i = 100;
+		crzy64_stats_sum(&r1);
+		test_hpp_encode(src.data(), i);
+		crzy64_stats_sum(&r2);
+		/* 7-bit size */
+		if (r2.hist[0][7] != r1.hist[0][7] + 1)
+			ERR("the counters aren't shared between translation units");
+	}
+#endif
+	return 0;
+}
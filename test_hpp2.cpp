@@ -0,0 +1,18 @@
+/* The second translation unit of test_hpp, to check that the state
+ * of the inline functions is shared. */
+
+#include "crzy64.hpp"
+#include "crzy64_pool.h"
+
+/* returns the address of a pooled buffer after releasing it */
+const void *test_hpp_pool(const void *s, std::size_t n) {
+	return crzy64::encode_pooled(s, n).data();
+}
+
+#if CRZY64_STATS
+/* for the counters of this unit, (n) up to 192 */
+void test_hpp_encode(const void *s, std::size_t n) {
+	std::uint8_t buf[256];
+	crzy64_encode(buf, (const std::uint8_t*)s, n);
+}
+#endif
@@ -0,0 +1,119 @@
+/*
+ * Built by "make tune" once per configuration of the grid, prints a
+ * line with the parameters and the encode/decode MB/s at several
+ * working set sizes. With --pick reads these lines and writes the
+ * config header for the best configuration (the geometric mean of
+ * all the speeds) to stdout.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <math.h>
+
+#include "crzy64.h"
+
+/* L1, L2, LLC, memory */
+#define TUNE_SIZES 4
+static const size_t tune_size[TUNE_SIZES] = {
+	3 << 10, 3 << 15, 3 << 19, 3 << 24
+};
+
+static int64_t get_time(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * (int64_t)1000000000 + t.tv_nsec;
+}
+
+/* the best of 5 runs over (total) bytes, MB/s of raw data */
+static double tune_run(int dec, uint8_t *buf, uint8_t *out,
+		size_t n, size_t total) {
+	size_t n2 = crzy64_encoded_size(n), k, nn = total / n;
+	int64_t t, best = 0;
+	int r;
+	for (r = 0; r < 6; r++) {
+		t = get_time();
+		for (k = 0; k < nn; k++)
+			if (dec) crzy64_decode(buf, out, n2);
+			else crzy64_encode(out, buf, n);
+		t = get_time() - t;
+		/* the first is a warmup */
+		if (r == 1 || (r && t < best)) best = t;
+	}
+	return (double)n * nn * (1e9 / (1 << 20)) / best;
+}
+
+static int tune_pick(void) {
+	char line[512], best_line[512] = "";
+	double best = 0;
+	int unroll = 0, dist = 0, branchless = 0;
+	char cpu[256] = "unknown", *p;
+	FILE *f;
+
+	while (fgets(line, sizeof(line), stdin)) {
+		double v[TUNE_SIZES * 2], sum = 0;
+		int u, d, b, i, k;
+		if (sscanf(line, "unroll %d prefetch %d branchless %d%n",
+				&u, &d, &b, &k) != 3) continue;
+		for (p = line + k, i = 0; i < TUNE_SIZES * 2; i++) {
+			v[i] = strtod(p, &p);
+			if (!(v[i] > 0)) break;
+			sum += log(v[i]);
+		}
+		if (i < TUNE_SIZES * 2) continue;
+		sum = exp(sum / i);
+		fprintf(stderr, "%s", line);
+		if (sum > best) {
+			best = sum;
+			unroll = u; dist = d; branchless = b;
+			strcpy(best_line, line);
+		}
+	}
+	if (!best) {
+		fprintf(stderr, "crzy64_tune: no results\n");
+		return 1;
+	}
+	if ((f = fopen("/proc/cpuinfo", "r"))) {
+		while (fgets(line, sizeof(line), f))
+			if (!strncmp(line, "model name", 10) && (p = strchr(line, ':'))) {
+				strcpy(cpu, p + 2);
+				if ((p = strchr(cpu, '\n'))) *p = 0;
+				break;
+			}
+		fclose(f);
+	}
+	if ((p = strchr(best_line, '\n'))) *p = 0;
+	printf("/* generated by \"make tune\" for %s\n"
+			" * %s\n"
+			" * encode and decode MB/s at 3K, 96K, 1.5M and 48M */\n\n"
+			"#ifndef CRZY64_UNROLL\n#define CRZY64_UNROLL %d\n#endif\n\n"
+			"#ifndef CRZY64_PREFETCH_DIST\n#define CRZY64_PREFETCH_DIST %d\n#endif\n\n"
+			"#ifndef CRZY64_BRANCHLESS\n#define CRZY64_BRANCHLESS %d\n#endif\n",
+			cpu, best_line, unroll, dist, branchless);
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	size_t n = tune_size[TUNE_SIZES - 1], i;
+	uint8_t *buf, *out;
+	int j, dec;
+
+	if (argc > 1 && !strcmp(argv[1], "--pick")) return tune_pick();
+
+	if (!(buf = (uint8_t*)malloc(n + crzy64_encoded_size(n)))) return 1;
+	out = buf + n;
+	for (i = 0; i < n; i++) buf[i] = i * 0x9e3779b1 >> 24;
+	crzy64_encode(out, buf, n);
+
+	printf("unroll %d prefetch %d branchless %d",
+			CRZY64_UNROLL, CRZY64_PREFETCH_DIST, CRZY64_BRANCHLESS);
+	for (dec = 0; dec < 2; dec++)
+	for (j = 0; j < TUNE_SIZES; j++)
+		printf(" %.1f", tune_run(dec, buf, out, tune_size[j], 3 << 24));
+	printf("\n");
+	free(buf);
+	return 0;
+}